@@ -0,0 +1,152 @@
+/*
+ * Micro-benchmark of the grid broadphase against FCL's dynamic AABB tree on
+ * spheres, outside MBDyn.  For each number of spheres the spheres are put at
+ * random in a cube, at a packing fraction of about one third, and moved by a
+ * small random step before each of the timed update and collide calls.
+ *
+ *     broadphase [--sizes 10000,100000,1000000] [--steps 10] [--threads 1]
+ *
+ * prints one line per manager and size: the time to register and set up the
+ * spheres, the mean time of update and of collide, and the number of pairs
+ * found, which must be the same for both managers.  See the Makefile.
+ */
+
+#include "mbconfig.h"           /* This goes first in every *.c,*.cc file */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <time.h>
+
+#include "gridbroadphase.h"
+
+static double
+dGetWallTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+}
+
+static bool
+CountPairs(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* cdata)
+{
+    ++*static_cast<std::size_t*>(cdata);
+    return false;
+}
+
+struct Result {
+    double setup;
+    double update;
+    double collide;
+    std::size_t pairs;
+};
+
+static Result
+Run(fcl::BroadPhaseCollisionManager* pManager, std::size_t N, int steps, unsigned seed)
+{
+    const fcl::FCL_REAL radius(0.5);
+    /* N spheres of volume 4/3 pi r^3 fill a third of a cube of side L */
+    const fcl::FCL_REAL L(std::pow(4.0 * M_PI * radius * radius * radius * N, 1.0 / 3.0));
+    const fcl::FCL_REAL step(0.05 * radius);
+    boost::shared_ptr<fcl::CollisionGeometry> sphere(new fcl::Sphere(radius));
+    std::vector<fcl::CollisionObject*> objects(N);
+    std::srand(seed);
+    for (std::size_t i = 0; i < N; i++) {
+        const fcl::Vec3f x(L * std::rand() / RAND_MAX, L * std::rand() / RAND_MAX, L * std::rand() / RAND_MAX);
+        objects[i] = new fcl::CollisionObject(sphere, fcl::Transform3f(x));
+        objects[i]->computeAABB();
+    }
+
+    Result r;
+    double t(dGetWallTime());
+    pManager->registerObjects(objects);
+    pManager->setup();
+    r.setup = dGetWallTime() - t;
+    r.update = 0.0;
+    r.collide = 0.0;
+    r.pairs = 0;
+    for (int s = 0; s < steps; s++) {
+        for (std::size_t i = 0; i < N; i++) {
+            const fcl::Vec3f d(step * (2.0 * std::rand() / RAND_MAX - 1.0),
+                step * (2.0 * std::rand() / RAND_MAX - 1.0),
+                step * (2.0 * std::rand() / RAND_MAX - 1.0));
+            objects[i]->setTranslation(objects[i]->getTranslation() + d);
+            objects[i]->computeAABB();
+        }
+        t = dGetWallTime();
+        pManager->update();
+        const double t1(dGetWallTime());
+        std::size_t pairs(0);
+        pManager->collide(&pairs, CountPairs);
+        const double t2(dGetWallTime());
+        r.update += t1 - t;
+        r.collide += t2 - t1;
+        r.pairs += pairs;
+    }
+    r.update /= steps;
+    r.collide /= steps;
+
+    pManager->clear();
+    for (std::size_t i = 0; i < N; i++) {
+        delete objects[i];
+    }
+    return r;
+}
+
+int
+main(int argc, char* argv[])
+{
+    std::string sizes("10000,100000,1000000");
+    int steps(10);
+    unsigned threads(1);
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            sizes = argv[++i];
+        } else if (std::strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            steps = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = std::atoi(argv[++i]);
+        } else {
+            std::fprintf(stderr, "usage: %s [--sizes n,n,...] [--steps n] [--threads n]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (steps < 1 || threads < 1) {
+        std::fprintf(stderr, "%s: steps and threads must be positive\n", argv[0]);
+        return 1;
+    }
+#ifndef USE_MULTITHREAD
+    if (threads > 1) {
+        std::fprintf(stderr, "%s: built without USE_MULTITHREAD, the grid runs on one thread\n", argv[0]);
+        threads = 1;
+    }
+#endif
+
+    std::printf("%-8s %10s %10s %12s %12s %12s\n", "manager", "spheres", "setup_s", "update_s", "collide_s", "pairs/step");
+    for (const char* p = sizes.c_str(); *p != '\0'; ) {
+        char* end;
+        const std::size_t N(std::strtoul(p, &end, 10));
+        p = (*end == ',') ? end + 1 : end;
+        if (N == 0) {
+            break;
+        }
+        FCL::GridCollisionManager grid(threads);
+        fcl::DynamicAABBTreeCollisionManager tree;
+        const Result g(Run(&grid, N, steps, 1));
+        const Result a(Run(&tree, N, steps, 1));
+        std::printf("%-8s %10lu %10.4g %12.4g %12.4g %12.1f\n", "grid", (unsigned long)N,
+            g.setup, g.update, g.collide, double(g.pairs) / steps);
+        std::printf("%-8s %10lu %10.4g %12.4g %12.4g %12.1f\n", "tree", (unsigned long)N,
+            a.setup, a.update, a.collide, double(a.pairs) / steps);
+        if (g.pairs != a.pairs) {
+            std::fprintf(stderr, "%lu spheres: the grid found %lu pairs, the tree %lu\n", (unsigned long)N,
+                (unsigned long)g.pairs, (unsigned long)a.pairs);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+"""
+Writes the scaling benchmark decks of module-collision.
+
+    generate.py [--sizes 10,100,1000] [--steps 200] [--cases drop,slide,wheel]
+        [--broadphase "subdomains, 4, threads, 4"] [--dir decks]
+
+Three cases are generated for each size N:
+
+    drop    N spheres falling into an open box made of five planes
+    slide   N bricks thrown along a plane with friction
+    wheel   N wheels, cylinders on their side, rolling on a plane
+
+Each deck logs the world private data step_wall_time and collision_time
+through two abstract nodes clamped to them, labels STEP_TIME and
+COLLISION_TIME in the .abs output; being drives read during assembly, the
+value logged at a step is the one of the step before, and the value logged
+at step 1 is that of the initial derivatives.
+"""
+
+import argparse
+import math
+import os
+
+WORLD = 90000
+STEP_TIME = 90001
+COLLISION_TIME = 90002
+GROUND = 1
+
+RADIUS = 0.05
+BRICK = (0.1, 0.05, 0.025)
+WHEEL = (0.2, 0.05)
+DENSITY = 1000.0
+STIFFNESS = 1.0e6
+DAMPING = 1.0e2
+FRICTION = 0.5
+
+
+def sphere_inertia(r):
+    m = DENSITY * 4.0 / 3.0 * math.pi * r ** 3
+    return m, (0.4 * m * r * r,) * 3
+
+
+def box_inertia(a, b, c):
+    m = DENSITY * 8.0 * a * b * c
+    return m, (m * (b * b + c * c) / 3.0, m * (a * a + c * c) / 3.0, m * (a * a + b * b) / 3.0)
+
+
+def cylinder_inertia(r, h):
+    m = DENSITY * math.pi * r * r * h
+    t = m * (3.0 * r * r + h * h) / 12.0
+    return m, (t, t, 0.5 * m * r * r)
+
+
+def grid(n, pitch):
+    """Positions of n points on a square grid of layers, centered on the z axis."""
+    side = max(1, int(math.ceil(math.sqrt(n))))
+    points = []
+    for i in range(n):
+        layer, k = divmod(i, side * side)
+        row, col = divmod(k, side)
+        points.append(((col - 0.5 * (side - 1)) * pitch, (row - 0.5 * (side - 1)) * pitch, layer * pitch))
+    return points, side
+
+
+def fmt(*values):
+    return ", ".join("%.9g" % v for v in values)
+
+
+class Deck(object):
+    def __init__(self, name, steps, dt):
+        self.name = name
+        self.steps = steps
+        self.dt = dt
+        self.nodes = []
+        self.bodies = []
+        self.objects = []
+
+    def node(self, label, x, v=(0.0, 0.0, 0.0), w=(0.0, 0.0, 0.0)):
+        self.nodes.append("    structural: %d, dynamic, %s, eye, %s, %s;" % (label, fmt(*x), fmt(*v), fmt(*w)))
+
+    def body(self, label, mass, inertia):
+        self.bodies.append("    body: %d, %d, %s, null, diag, %s;" % (label, label, fmt(mass), fmt(*inertia)))
+
+    def object(self, label, node, shape, orientation="eye", offset="null"):
+        self.objects.append((label, "    user defined: %d, collision object, %d, %s, %s, \"steel\", %s;"
+            % (label, node, offset, orientation, shape)))
+
+    def write(self, path, world_options):
+        labels = ", ".join(str(label) for label, _ in self.objects)
+        with open(path, "w") as f:
+            f.write("# %s, generated by benchmarks/generate.py\n\n" % self.name)
+            f.write("begin: data;\n    problem: initial value;\nend: data;\n\n")
+            f.write("begin: initial value;\n")
+            f.write("    initial time: 0.;\n    final time: %s;\n    time step: %s;\n" % (fmt(self.steps * self.dt), fmt(self.dt)))
+            f.write("    max iterations: 50;\n    tolerance: 1.e-6;\n    derivatives tolerance: 1.e6;\n")
+            f.write("    method: ms, .6;\nend: initial value;\n\n")
+            f.write("begin: control data;\n")
+            f.write("    structural nodes: %d;\n" % (len(self.nodes) + 1))
+            f.write("    abstract nodes: 2;\n")
+            f.write("    rigid bodies: %d;\n" % len(self.bodies))
+            f.write("    joints: 1;\n    genels: 2;\n    gravity;\n")
+            f.write("    loadable elements: %d;\n" % (len(self.objects) + 1))
+            f.write("end: control data;\n\n")
+            f.write("module load: \"libmodule-collision\";\n\n")
+            f.write("begin: nodes;\n")
+            f.write("    structural: %d, static, null, eye, null, null;\n" % GROUND)
+            f.write("\n".join(self.nodes) + "\n")
+            f.write("    abstract: %d;\n    abstract: %d;\n" % (STEP_TIME, COLLISION_TIME))
+            f.write("end: nodes;\n\n")
+            f.write("begin: elements;\n")
+            f.write("    joint: %d, clamp, %d, node, node;\n" % (GROUND, GROUND))
+            f.write("    gravity: uniform, 0., 0., -1., const, 9.81;\n")
+            f.write("\n".join(self.bodies) + "\n")
+            f.write("\n".join(line for _, line in self.objects) + "\n")
+            f.write("    user defined: %d, collision world,\n" % WORLD)
+            f.write("        material pairs, 1, \"steel\", \"steel\", linear viscoelastic, %s,\n" % fmt(STIFFNESS, DAMPING))
+            f.write("            friction function, \"friction\", const, %s,\n" % fmt(FRICTION))
+            f.write("        collision objects, %d, %s%s;\n" % (len(self.objects), labels, world_options))
+            for label, name in ((STEP_TIME, "step_wall_time"), (COLLISION_TIME, "collision_time")):
+                f.write("    genel: %d, clamp, %d, abstract, element, %d, loadable, string, \"%s\", direct;\n"
+                    % (label, label, WORLD, name))
+            f.write("end: elements;\n")
+
+
+# plane normals (local z) of the floor and the four walls, as orientation matrices
+WALLS = (
+    ("3, 0., 0., 1., 1, 1., 0., 0.", (0.0, 0.0, 0.0)),
+    ("3, 1., 0., 0., 2, 0., 1., 0.", (-1.0, 0.0, 0.0)),
+    ("3, -1., 0., 0., 2, 0., 1., 0.", (1.0, 0.0, 0.0)),
+    ("3, 0., 1., 0., 1, 1., 0., 0.", (0.0, -1.0, 0.0)),
+    ("3, 0., -1., 0., 1, 1., 0., 0.", (0.0, 1.0, 0.0)),
+)
+
+
+def drop(n, steps):
+    deck = Deck("drop-%d" % n, steps, 1.0e-3)
+    pitch = 2.5 * RADIUS
+    points, side = grid(n, pitch)
+    half = 0.5 * side * pitch + RADIUS
+    for i, (x, y, z) in enumerate(points):
+        label = 2 + i
+        deck.node(label, (x, y, z + 2.0 * RADIUS))
+        deck.body(label, *sphere_inertia(RADIUS))
+        deck.object(1000000 + label, label, "sphere, %s" % fmt(RADIUS))
+    for i, (orientation, direction) in enumerate(WALLS):
+        offset = fmt(*(half * d for d in direction))
+        deck.object(10 + i, GROUND, "plane", orientation, offset)
+    return deck
+
+
+def slide(n, steps):
+    deck = Deck("slide-%d" % n, steps, 1.0e-3)
+    a, b, c = BRICK
+    side = max(1, int(math.ceil(math.sqrt(n))))
+    for i in range(n):
+        row, col = divmod(i, side)
+        label = 2 + i
+        deck.node(label, (col * 4.0 * a, row * 4.0 * b, c), (1.0 + 0.01 * (i % 7), 0.0, 0.0))
+        deck.body(label, *box_inertia(a, b, c))
+        deck.object(1000000 + label, label, "box, %s" % fmt(a, b, c))
+    deck.object(10, GROUND, "plane")
+    return deck
+
+
+def wheel(n, steps):
+    deck = Deck("wheel-%d" % n, steps, 1.0e-3)
+    r, h = WHEEL
+    v = 1.0
+    for i in range(n):
+        label = 2 + i
+        deck.node(label, (0.0, i * 3.0 * h, r), (v, 0.0, 0.0), (0.0, v / r, 0.0))
+        deck.body(label, *cylinder_inertia(r, h))
+        # the cylinder axis, local z, lies along y
+        deck.object(1000000 + label, label, "cylinder, %s" % fmt(r, h), "3, 0., 1., 0., 1, 1., 0., 0.")
+    deck.object(10, GROUND, "plane")
+    return deck
+
+
+CASES = {"drop": drop, "slide": slide, "wheel": wheel}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Write the module-collision scaling benchmark decks.")
+    parser.add_argument("--sizes", default="10,100,1000", help="comma separated numbers of bodies")
+    parser.add_argument("--steps", type=int, default=200, help="time steps per run")
+    parser.add_argument("--cases", default=",".join(sorted(CASES)), help="comma separated cases")
+    parser.add_argument("--broadphase", default="", help="e.g. \"subdomains, 4, threads, 4\"")
+    parser.add_argument("--dir", default="decks", help="output directory")
+    args = parser.parse_args()
+    world_options = ",\n        broadphase, %s" % args.broadphase if args.broadphase else ""
+    if not os.path.isdir(args.dir):
+        os.makedirs(args.dir)
+    for case in args.cases.split(","):
+        for n in (int(s) for s in args.sizes.split(",")):
+            deck = CASES[case](n, args.steps)
+            path = os.path.join(args.dir, deck.name + ".mbd")
+            deck.write(path, world_options)
+            print(path)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,130 @@
+/*
+ * Micro-benchmark of the convex narrowphase of module-collision on stacks,
+ * outside MBDyn.  A stack of capsules or boxes stands along z, each body
+ * sinking slightly into the one below, and every step moves and turns each
+ * body by a small random amount, as between Newton iterations.  Each pair of
+ * neighbours goes through the kernel of the FuncMatrix twice per step: with
+ * the cache it kept from the step before, and with a fresh one.
+ *
+ *     narrowphase [--bodies 100] [--steps 1000]
+ *
+ * prints one line per shape: the mean time of a kernel call warm and cold,
+ * their ratio, and the contacts found per step, which must be the same.
+ * FCL solves box-box in closed form, so the boxes show the cost of the
+ * contact patch rather than of the warm start.  See the Makefile.
+ */
+
+#include "mbconfig.h"           /* This goes first in every *.c,*.cc file */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <time.h>
+
+#include "intersect.h"
+
+static double
+dGetWallTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+}
+
+static double
+dRandom(double a)
+{
+    return a * (2.0 * std::rand() / RAND_MAX - 1.0);
+}
+
+struct Result {
+    double warm;
+    double cold;
+    std::size_t warm_contacts;
+    std::size_t cold_contacts;
+};
+
+static Result
+Run(const boost::shared_ptr<fcl::CollisionGeometry>& shape, fcl::FCL_REAL height, std::size_t N, int steps)
+{
+    const FCL::FuncMatrix func_matrix;
+    const fcl::FCL_REAL overlap(1.0e-3);
+    std::vector<fcl::CollisionObject*> objects(N);
+    for (std::size_t i = 0; i < N; i++) {
+        objects[i] = new fcl::CollisionObject(shape, fcl::Transform3f(fcl::Vec3f(0.0, 0.0, i * (height - overlap))));
+    }
+    std::vector<FCL::NarrowphaseCache> caches(N);
+    FCL::Vec3f_pairs pairs;
+    Result r;
+    r.warm = 0.0;
+    r.cold = 0.0;
+    r.warm_contacts = 0;
+    r.cold_contacts = 0;
+    std::srand(1);
+    for (int s = 0; s < steps; s++) {
+        for (std::size_t i = 0; i < N; i++) {
+            fcl::Matrix3f R;
+            R.setEulerZYX(dRandom(1.0e-3), dRandom(1.0e-3), dRandom(1.0e-3));
+            const fcl::Vec3f x(dRandom(1.0e-5), dRandom(1.0e-5), i * (height - overlap) + dRandom(1.0e-5));
+            objects[i]->setTransform(R, x);
+            objects[i]->computeAABB();
+        }
+        const FCL::Func func(func_matrix.GetFunc(std::make_pair(objects[0], objects[1])));
+        double t(dGetWallTime());
+        for (std::size_t i = 0; i + 1 < N; i++) {
+            pairs.clear();
+            func(objects[i], objects[i + 1], 0.0, caches[i], pairs);
+            r.warm_contacts += pairs.size();
+        }
+        const double t1(dGetWallTime());
+        for (std::size_t i = 0; i + 1 < N; i++) {
+            FCL::NarrowphaseCache cold;
+            pairs.clear();
+            func(objects[i], objects[i + 1], 0.0, cold, pairs);
+            r.cold_contacts += pairs.size();
+        }
+        const double t2(dGetWallTime());
+        r.warm += t1 - t;
+        r.cold += t2 - t1;
+    }
+    r.warm /= double(steps) * (N - 1);
+    r.cold /= double(steps) * (N - 1);
+    for (std::size_t i = 0; i < N; i++) {
+        delete objects[i];
+    }
+    return r;
+}
+
+int
+main(int argc, char* argv[])
+{
+    std::size_t N(100);
+    int steps(1000);
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--bodies") == 0 && i + 1 < argc) {
+            N = std::strtoul(argv[++i], NULL, 10);
+        } else if (std::strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            steps = std::atoi(argv[++i]);
+        } else {
+            std::fprintf(stderr, "usage: %s [--bodies n] [--steps n]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (N < 2 || steps < 1) {
+        std::fprintf(stderr, "%s: at least two bodies and one step\n", argv[0]);
+        return 1;
+    }
+
+    /* capsules stand on their axis, boxes on their smallest side */
+    const Result c(Run(boost::shared_ptr<fcl::CollisionGeometry>(new fcl::Capsule(0.05, 0.1)), 0.2, N, steps));
+    const Result b(Run(boost::shared_ptr<fcl::CollisionGeometry>(new fcl::Box(0.2, 0.1, 0.05)), 0.05, N, steps));
+    std::printf("%-8s %12s %12s %8s %14s\n", "shape", "warm_s", "cold_s", "cold/warm", "contacts/step");
+    std::printf("%-8s %12.4g %12.4g %8.3g %14.1f\n", "capsule", c.warm, c.cold, c.cold / c.warm, double(c.warm_contacts) / steps);
+    std::printf("%-8s %12.4g %12.4g %8.3g %14.1f\n", "box", b.warm, b.cold, b.cold / b.warm, double(b.warm_contacts) / steps);
+    if (c.warm_contacts != c.cold_contacts || b.warm_contacts != b.cold_contacts) {
+        std::fprintf(stderr, "%s: warm and cold calls found different contacts\n", argv[0]);
+        return 1;
+    }
+    return 0;
+}
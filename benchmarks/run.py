@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""
+Runs the decks written by generate.py through MBDyn and records, for each,
+the wall time per step, the Newton iterations per step, the time spent in
+the collision world and the peak resident set size.
+
+    run.py [--mbdyn mbdyn] [--out results.json] decks/*.mbd
+
+Steps come from the Step lines of <deck>.out, the wall and collision times
+from the abstract nodes of <deck>.abs (see generate.py), the peak RSS from
+the rusage of the MBDyn process.  The results are one JSON object per deck,
+with per step series and their totals.
+
+MBDyn writes one Step line per output, "Step <n> <time> <dt> <iterations>
+<error> ...", step 0 being the initial derivatives, and one line per
+abstract node per output into the .abs file, "<label> <value> <derivative>".
+A deck whose files do not follow this, or whose .abs file has not one line
+per node and Step line, is reported as failed rather than misread.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import time
+
+STEP_TIME = 90001
+COLLISION_TIME = 90002
+
+
+def read_steps(path):
+    """Step number and Newton iterations of each output, from the Step lines of the .out file."""
+    steps = []
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) > 4 and fields[0] == "Step":
+                steps.append((int(fields[1]), int(fields[4])))
+    return steps
+
+
+def read_abstract(path, label, steps):
+    """Value of the abstract node at each step from 1, given the steps of the .out file."""
+    values = []
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) > 1 and int(fields[0]) == label:
+                values.append(float(fields[1]))
+    if len(values) != len(steps):
+        raise ValueError("%d lines of node %d for %d steps" % (len(values), label, len(steps)))
+    # each value is that of the step before, see generate.py, so the last step has none
+    return [values[i + 1] for i in range(len(steps) - 1) if steps[i][0] >= 1]
+
+
+def run(mbdyn, deck):
+    prefix = os.path.splitext(deck)[0]
+    with open(prefix + ".log", "w") as log:
+        start = time.time()
+        process = subprocess.Popen([mbdyn, "-f", deck, "-o", prefix], stdout=log, stderr=subprocess.STDOUT)
+        _, status, usage = os.wait4(process.pid, 0)
+        wall = time.time() - start
+    record = {
+        "deck": os.path.basename(deck),
+        "status": os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1,
+        "wall_time": wall,
+        # kilobytes on Linux
+        "peak_rss_kb": usage.ru_maxrss,
+    }
+    if record["status"] != 0:
+        sys.stderr.write("%s: mbdyn failed, see %s.log\n" % (deck, prefix))
+        return record
+    try:
+        steps = read_steps(prefix + ".out")
+        if not steps:
+            raise ValueError("no Step lines")
+        step_time = read_abstract(prefix + ".abs", STEP_TIME, steps)
+        collision_time = read_abstract(prefix + ".abs", COLLISION_TIME, steps)
+    except (IOError, ValueError) as e:
+        record["error"] = str(e)
+        sys.stderr.write("%s: cannot read the output of mbdyn: %s\n" % (deck, e))
+        return record
+    iterations = [n for step, n in steps if step >= 1]
+    steps = max(1, len(iterations))
+    record.update({
+        "steps": len(iterations),
+        "wall_time_per_step": wall / steps,
+        "iterations_per_step": sum(iterations) / float(steps),
+        "collision_time": sum(collision_time),
+        "collision_fraction": sum(collision_time) / sum(step_time) if sum(step_time) > 0.0 else 0.0,
+        "series": {
+            "iterations": iterations,
+            "step_time": step_time,
+            "collision_time": collision_time,
+        },
+    })
+    return record
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run the module-collision scaling benchmarks.")
+    parser.add_argument("--mbdyn", default="mbdyn", help="MBDyn executable")
+    parser.add_argument("--out", default="results.json", help="output file")
+    parser.add_argument("decks", nargs="+", help="decks written by generate.py")
+    args = parser.parse_args()
+    results = []
+    for deck in args.decks:
+        record = run(args.mbdyn, deck)
+        if "steps" in record:
+            sys.stderr.write("%s: %d steps, %.3g s/step, %.3g iterations/step, %.3g s in collision, %d kB\n"
+                % (record["deck"], record["steps"], record["wall_time_per_step"], record["iterations_per_step"],
+                record["collision_time"], record["peak_rss_kb"]))
+        results.append(record)
+    with open(args.out, "w") as f:
+        json.dump(results, f, indent=1)
+    if any("steps" not in record for record in results):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+"""
+Runs the drop deck of generate.py with the subdomains broadphase on n slabs
+and n workers, threads or processes, for each number of workers n, and
+reports how the wall time scales with n.
+
+    scaling.py [--mbdyn mbdyn] [--size 10000] [--steps 200] [--workers 1-64]
+        [--modes threads,processes] [--dir scaling] [--out scaling.json]
+        [--summary scaling.txt]
+
+--workers takes a comma separated list of numbers and ranges, e.g. 1,2,4-8.
+The JSON holds the record run.py makes of each deck, with the kind and number
+of workers and the largest distance between the final node positions and
+those of the very first run, which the slabs must not change beyond the
+tolerance of the solver.  The summary has one line per run: wall time per
+step, speedup and efficiency against the first run of the same kind,
+iterations per step, time spent in the collision world and that distance.
+"""
+
+import argparse
+import json
+import math
+import os
+import sys
+
+import generate
+import run
+
+
+def parse_workers(spec):
+    workers = []
+    for item in spec.split(","):
+        first, _, last = item.partition("-")
+        workers.extend(range(int(first), int(last or first) + 1))
+    return workers
+
+
+def final_positions(path):
+    """Position of each node at the last step, from the .mov file."""
+    positions = {}
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) > 3:
+                positions[int(fields[0])] = tuple(float(x) for x in fields[1:4])
+    return positions
+
+
+def max_distance(a, b):
+    return max(math.sqrt(sum((p - q) ** 2 for p, q in zip(a[label], b[label]))) for label in a if label in b)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Scale the subdomains broadphase of module-collision over workers.")
+    parser.add_argument("--mbdyn", default="mbdyn", help="MBDyn executable")
+    parser.add_argument("--size", type=int, default=10000, help="number of spheres")
+    parser.add_argument("--steps", type=int, default=200, help="time steps per run")
+    parser.add_argument("--workers", default="1-64", help="numbers of slabs and workers, e.g. 1,2,4-8")
+    parser.add_argument("--modes", default="threads,processes", help="kinds of workers")
+    parser.add_argument("--dir", default="scaling", help="directory of the decks and their output")
+    parser.add_argument("--out", default="scaling.json", help="output file")
+    parser.add_argument("--summary", default="scaling.txt", help="summary file")
+    args = parser.parse_args()
+
+    results = []
+    positions0 = None
+    first = {}
+    for mode in args.modes.split(","):
+        for n in parse_workers(args.workers):
+            path = os.path.join(args.dir, "%s-%d" % (mode, n))
+            if not os.path.isdir(path):
+                os.makedirs(path)
+            deck = generate.drop(args.size, args.steps)
+            deck_path = os.path.join(path, deck.name + ".mbd")
+            deck.write(deck_path, ",\n        broadphase, subdomains, %d, %s, %d" % (n, mode, n))
+            record = run.run(args.mbdyn, deck_path)
+            record["mode"] = mode
+            record["workers"] = n
+            if "steps" in record:
+                positions = final_positions(os.path.splitext(deck_path)[0] + ".mov")
+                if positions0 is None:
+                    positions0 = positions
+                first.setdefault(mode, record)
+                record["max_position_difference"] = max_distance(positions, positions0)
+            results.append(record)
+            with open(args.out, "w") as f:
+                json.dump(results, f, indent=1)
+
+    lines = ["%-10s %8s %12s %9s %11s %12s %12s %14s" % ("mode", "workers", "s/step", "speedup", "efficiency",
+        "iter/step", "collision_s", "max_dx")]
+    for record in results:
+        if "steps" not in record:
+            lines.append("%-10s %8d %12s" % (record["mode"], record["workers"], "failed"))
+            continue
+        reference = first[record["mode"]]
+        speedup = reference["wall_time_per_step"] / record["wall_time_per_step"]
+        lines.append("%-10s %8d %12.4g %9.3g %11.3g %12.3g %12.4g %14.3g" % (record["mode"], record["workers"],
+            record["wall_time_per_step"], speedup, speedup * reference["workers"] / record["workers"],
+            record["iterations_per_step"], record["collision_time"], record["max_position_difference"]))
+    with open(args.summary, "w") as f:
+        f.write("drop, %d spheres, %d steps\n" % (args.size, args.steps))
+        f.write("\n".join(lines) + "\n")
+    sys.stderr.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    main()
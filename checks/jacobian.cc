@@ -0,0 +1,297 @@
+/*
+ * Checks the 12x12 contact block that CollisionBlock::AssJac assembles
+ * against central differences of CollisionBlock::AssRes, outside MBDyn's
+ * solver.  Each case places two nodes, finds the contacts of one pair once,
+ * and then perturbs each derivative unknown of the block in turn: velocity
+ * and angular velocity by h, position by dCoef h and orientation by the
+ * rotation of dCoef h, with the angular velocity following the rotated
+ * reference one.  The contacts are kept as found, as they are within a step.
+ *
+ *     jacobian [--dcoef 0.05] [--step 1e-6] [--tolerance 1e-5]
+ *
+ * prints, for each case, the largest coefficient of the block and the
+ * largest difference to the central differences, relative to it, and exits
+ * with 1 if any difference exceeds the tolerance.  See the Makefile.
+ *
+ *     slip        sphere on a plane, sliding with velocity dependent friction
+ *     stick       sphere on a plane, held by the stick spring within the cone
+ *     spring slip sphere on a plane, the stick spring beyond the cone
+ *     speculative capsule on a plane with a margin, one end closed and the
+ *                 other within the margin
+ *     face        box resting tilted on a plane, four contacts
+ */
+
+#include "mbconfig.h"           /* This goes first in every *.c,*.cc file */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "dataman.h"
+#include "strnode.h"
+#include "matvecexp.h"
+#include "ScalarFunctions.h"
+#include "module-collision.h"
+
+/* a node whose state is set directly, as the solver would between iterations */
+class CheckNode : public DynamicStructNode {
+public:
+    CheckNode(unsigned uLabel, const DofOwner* pDO)
+    : DynamicStructNode(uLabel, pDO, Zero3, Eye3, Zero3, Zero3, NULL, NULL,
+        1., 1., false, ORIENTATION_VECTOR, flag(0))
+    {
+        NO_OP;
+    };
+    void Set(const Vec3& X, const Mat3x3& R, const Vec3& V, const Vec3& W, const Vec3& W0) {
+        XCurr = X;
+        RCurr = R;
+        RRef = R;
+        VCurr = V;
+        WCurr = W;
+        WRef = W0;
+    };
+};
+
+/* mu_k + (mu_s - mu_k) / (1 + (v / v0)^2), smooth from the static to the kinetic coefficient */
+class CheckFriction : public DifferentiableScalarFunction {
+private:
+    const doublereal mu_s;
+    const doublereal mu_k;
+    const doublereal v0;
+public:
+    CheckFriction(doublereal mu_s, doublereal mu_k, doublereal v0)
+    : mu_s(mu_s), mu_k(mu_k), v0(v0)
+    {
+        NO_OP;
+    };
+    doublereal operator()(const doublereal v) const {
+        const doublereal u(v / v0);
+        return mu_k + (mu_s - mu_k) / (1. + u * u);
+    };
+    doublereal ComputeDiff(const doublereal v, const integer order = 1) const {
+        const doublereal u(v / v0);
+        const doublereal d(1. + u * u);
+        return -(mu_s - mu_k) * 2. * u / (v0 * d * d);
+    };
+};
+
+struct State {
+    Vec3 X;
+    Mat3x3 R;
+    Vec3 V;
+    Vec3 W;
+};
+
+struct Case {
+    const char* name;
+    fcl::CollisionGeometry* pShape1;
+    doublereal margin;
+    State s1;
+    State s2;
+    doublereal dStickStiffness;
+    /* added to the stick anchor on node 2 of each contact, in the world frame */
+    Vec3 anchor;
+};
+
+static void
+Place(fcl::CollisionObject* pObject, const State& s)
+{
+    const Mat3x3& r(s.R);
+    pObject->setTransform(
+        fcl::Matrix3f(r.dGet(1,1),r.dGet(1,2),r.dGet(1,3),r.dGet(2,1),r.dGet(2,2),r.dGet(2,3),r.dGet(3,1),r.dGet(3,2),r.dGet(3,3)),
+        fcl::Vec3f(s.X(1), s.X(2), s.X(3)));
+    pObject->computeAABB();
+}
+
+static void
+Set(CheckNode* pNode, const State& s0, integer iCol, doublereal dCoef, doublereal h)
+{
+    /* column iCol of the node, 1 to 6, moved by h; 0 leaves the state as it is */
+    Vec3 X(s0.X);
+    Mat3x3 R(s0.R);
+    Vec3 V(s0.V);
+    Vec3 W(s0.W);
+    if (iCol >= 1 && iCol <= 3) {
+        V(iCol) += h;
+        X(iCol) += dCoef * h;
+    } else if (iCol >= 4 && iCol <= 6) {
+        Vec3 g(Zero3);
+        g(iCol - 3) = dCoef * h;
+        R = RotManip::Rot(g) * s0.R;
+        Vec3 e(Zero3);
+        e(iCol - 3) = h;
+        W += e + g.Cross(s0.W);
+    }
+    pNode->Set(X, R, V, W, s0.W);
+}
+
+static bool
+Check(const Case& c, doublereal dCoef, doublereal h, doublereal dTolerance)
+{
+    const int iSize(CollisionBlock::iBlockSize);
+    DofOwner dof;
+    CheckNode node1(1, &dof);
+    CheckNode node2(2, &dof);
+    node1.Set(c.s1.X, c.s1.R, c.s1.V, c.s1.W, c.s1.W);
+    node2.Set(c.s2.X, c.s2.R, c.s2.V, c.s2.W, c.s2.W);
+
+    const CheckFriction friction(0.6, 0.4, 0.05);
+    CollisionMaterial material(1.e7, 1.5, 1.e3, &friction, 0.5, c.dStickStiffness);
+    fcl::CollisionObject object1(boost::shared_ptr<fcl::CollisionGeometry>(c.pShape1));
+    fcl::CollisionObject object2(boost::shared_ptr<fcl::CollisionGeometry>(new fcl::Plane(0., 0., 1., 0.)));
+    Place(&object1, c.s1);
+    Place(&object2, c.s2);
+    CollisionObjectData data1(&node1, &object1, "check", Zero3, Eye3, false, c.margin);
+    CollisionObjectData data2(&node2, &object2, "check", Zero3, Eye3, true, 0.);
+    const FCL::FuncMatrix func_matrix;
+    ContactBuffer buffer;
+    Collision collision(func_matrix.GetFunc(std::make_pair(&object1, &object2)), &material, false, &data1, &data2, &buffer);
+    CollisionBlock block(&node1, &node2);
+    block.Add(&collision);
+    collision.Intersect();
+    std::vector<Collision*> order;
+    block.Gather(buffer, order, false);
+    collision.ClearAndSetTangents();
+    const Mat3x3 R2(c.s2.R);
+    for (std::size_t i = 0; i < buffer.Size(); i++) {
+        buffer.s2[i] += R2.Transpose() * c.anchor;
+    }
+
+    MyVectorHandler X(iSize);
+    MyVectorHandler XP(iSize);
+    MySubVectorHandler vec(iSize);
+    VariableSubMatrixHandler mat(iSize, iSize, iSize * iSize);
+    FullSubMatrixHandler& WM = mat.SetFull();
+    WM.ResizeReset(iSize, iSize);
+    block.AssJac(mat, dCoef, X, XP);
+
+    std::vector<doublereal> plus(iSize);
+    std::vector<doublereal> minus(iSize);
+    doublereal dMaxCoef(0.);
+    doublereal dMaxDiff(0.);
+    for (int iCol = 1; iCol <= iSize; iCol++) {
+        CheckNode* pNode(iCol <= iSize / 2 ? &node1 : &node2);
+        const State& s0(iCol <= iSize / 2 ? c.s1 : c.s2);
+        const integer iNodeCol(iCol <= iSize / 2 ? iCol : iCol - iSize / 2);
+        for (int iSign = 1; iSign >= -1; iSign -= 2) {
+            Set(pNode, s0, iNodeCol, dCoef, iSign * h);
+            vec.ResizeReset(iSize);
+            block.AssRes(vec, dCoef, X, XP);
+            std::vector<doublereal>& f(iSign > 0 ? plus : minus);
+            for (int iRow = 1; iRow <= iSize; iRow++) {
+                f[iRow - 1] = vec.dGetCoef(iRow);
+            }
+        }
+        Set(pNode, s0, 0, dCoef, 0.);
+        for (int iRow = 1; iRow <= iSize; iRow++) {
+            /* the Jacobian is that of minus the residual */
+            const doublereal dFD(-(plus[iRow - 1] - minus[iRow - 1]) / (2. * h));
+            dMaxCoef = std::max(dMaxCoef, std::abs(WM.dGetCoef(iRow, iCol)));
+            dMaxDiff = std::max(dMaxDiff, std::abs(WM.dGetCoef(iRow, iCol) - dFD));
+        }
+    }
+    const doublereal dRelDiff(dMaxDiff / std::max(dMaxCoef, std::numeric_limits<doublereal>::min()));
+    const bool bPass(buffer.Size() > 0 && dRelDiff <= dTolerance);
+    std::printf("%-12s %8lu %12.4g %12.4g %s\n", c.name, (unsigned long)buffer.Size(), dMaxCoef, dRelDiff,
+        bPass ? "ok" : "FAILED");
+    return bPass;
+}
+
+int
+main(int argc, char* argv[])
+{
+    doublereal dCoef(0.05);
+    doublereal h(1.e-6);
+    doublereal dTolerance(1.e-5);
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--dcoef") == 0 && i + 1 < argc) {
+            dCoef = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--step") == 0 && i + 1 < argc) {
+            h = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            dTolerance = std::atof(argv[++i]);
+        } else {
+            std::fprintf(stderr, "usage: %s [--dcoef c] [--step h] [--tolerance t]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    /* the ground moves and turns too, so that the columns of node 2 are checked */
+    State ground;
+    ground.X = Vec3(0.01, -0.02, 0.);
+    ground.R = RotManip::Rot(Vec3(0.02, -0.01, 0.03));
+    ground.V = Vec3(0.01, 0.02, -0.01);
+    ground.W = Vec3(0.05, -0.03, 0.02);
+    const Vec3 up(ground.R.GetVec(3));
+
+    const doublereal r(0.1);
+    const doublereal depth(1.e-3);
+    State sphere;
+    sphere.X = ground.X + up * (r - depth) + ground.R * Vec3(0.03, 0.01, 0.);
+    sphere.R = RotManip::Rot(Vec3(0.3, -0.2, 0.1));
+    sphere.V = ground.V + ground.R * Vec3(0.2, -0.1, -0.01);
+    sphere.W = Vec3(0.5, 1., -0.3);
+    State creeping(sphere);
+    creeping.V = ground.V + ground.R * Vec3(0.004, 0.002, -0.01);
+
+    /* ends at -0.15 and 0.15 along x, the first 1e-3 into the plane, the second 1e-2 above it */
+    const doublereal rc(0.05);
+    const doublereal lc(0.3);
+    const doublereal tilt(std::asin(1.1e-2 / lc));
+    State capsule;
+    capsule.R = ground.R * RotManip::Rot(Vec3(0., M_PI / 2. - tilt, 0.));
+    capsule.X = ground.X + ground.R * Vec3(0., 0., rc - 1.e-3 + 0.5 * lc * std::sin(tilt));
+    capsule.V = ground.V + ground.R * Vec3(0.1, 0.05, -0.02);
+    capsule.W = ground.W + ground.R * Vec3(0.2, -0.1, 0.3);
+
+    const Vec3 half(0.1, 0.05, 0.025);
+    State box;
+    box.R = ground.R * RotManip::Rot(Vec3(0.002, -0.003, 0.4));
+    box.X = ground.X + up * (half(3) - 1.e-3);
+    box.V = ground.V + ground.R * Vec3(0.1, -0.05, -0.01);
+    box.W = ground.W + ground.R * Vec3(0.1, 0.2, -0.4);
+
+    std::vector<Case> cases;
+    Case c;
+    c.name = "slip";
+    c.pShape1 = new fcl::Sphere(r);
+    c.margin = 0.;
+    c.s1 = sphere;
+    c.s2 = ground;
+    c.dStickStiffness = 0.;
+    c.anchor = Zero3;
+    cases.push_back(c);
+    c.name = "stick";
+    c.pShape1 = new fcl::Sphere(r);
+    c.s1 = creeping;
+    c.dStickStiffness = 1.e5;
+    c.anchor = ground.R * Vec3(1.e-5, -2.e-5, 0.);
+    cases.push_back(c);
+    c.name = "spring slip";
+    c.pShape1 = new fcl::Sphere(r);
+    c.anchor = ground.R * Vec3(1.e-2, -2.e-2, 0.);
+    cases.push_back(c);
+    c.name = "speculative";
+    c.pShape1 = new fcl::Capsule(rc, lc);
+    c.margin = 2.e-2;
+    c.s1 = capsule;
+    c.dStickStiffness = 0.;
+    c.anchor = Zero3;
+    cases.push_back(c);
+    c.name = "face";
+    c.pShape1 = new fcl::Box(2. * half(1), 2. * half(2), 2. * half(3));
+    c.margin = 0.;
+    c.s1 = box;
+    cases.push_back(c);
+
+    std::printf("%-12s %8s %12s %12s\n", "case", "contacts", "max|J|", "max|J-FD|/max|J|");
+    bool bPass(true);
+    for (std::vector<Case>::const_iterator it = cases.begin(); it != cases.end(); it++) {
+        bPass = Check(*it, dCoef, h, dTolerance) && bPass;
+    }
+    return bPass ? 0 : 1;
+}
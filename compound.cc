@@ -0,0 +1,169 @@
+#include "mbconfig.h"           /* This goes first in every *.c,*.cc file */
+
+#include <algorithm>
+#include <cmath>
+
+#include "intersect.h"
+
+namespace FCL
+{
+
+namespace
+{
+const uint32_t leaf_size(2);
+
+class CompareCenters {
+private:
+    const std::vector<fcl::AABB>& boxes;
+    const int axis;
+public:
+    CompareCenters(const std::vector<fcl::AABB>& boxes, int axis) : boxes(boxes), axis(axis) {};
+    bool operator()(uint32_t i, uint32_t j) const {
+        return boxes[i].min_[axis] + boxes[i].max_[axis] < boxes[j].min_[axis] + boxes[j].max_[axis];
+    };
+};
+}
+
+fcl::AABB
+TransformAABB(const fcl::AABB& box, const fcl::Transform3f& tf)
+{
+    const fcl::Vec3f center(tf.transform(box.center()));
+    const fcl::Vec3f half((box.max_ - box.min_) * 0.5);
+    const fcl::Matrix3f& R(tf.getRotation());
+    fcl::Vec3f extent;
+    for (int i = 0; i < 3; i++) {
+        extent[i] = std::abs(R(i, 0)) * half[0] + std::abs(R(i, 1)) * half[1] + std::abs(R(i, 2)) * half[2];
+    }
+    return fcl::AABB(center - extent, center + extent);
+}
+
+Compound::Compound(void)
+{
+
+}
+
+Compound::~Compound(void)
+{
+    for (std::vector<fcl::CollisionObject*>::iterator it = children.begin(); it != children.end(); it++) {
+        delete *it;
+    }
+}
+
+void
+Compound::Add(const boost::shared_ptr<fcl::CollisionGeometry>& geometry, const fcl::Transform3f& tf)
+{
+    children.push_back(new fcl::CollisionObject(geometry, tf));
+    transforms.push_back(tf);
+    boxes.push_back(TransformAABB(geometry->aabb_local, tf));
+}
+
+void
+Compound::Setup(void)
+{
+    order.resize(children.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    nodes.clear();
+    if (!children.empty()) {
+        Build(0, children.size());
+    }
+    computeLocalAABB();
+}
+
+uint32_t
+Compound::Build(uint32_t begin, uint32_t end)
+{
+    const uint32_t index(nodes.size());
+    nodes.push_back(Node());
+    Node node;
+    node.box = boxes[order[begin]];
+    fcl::Vec3f cmin(node.box.center());
+    fcl::Vec3f cmax(cmin);
+    for (uint32_t i = begin; i < end; i++) {
+        node.box += boxes[order[i]];
+        cmin = fcl::min(cmin, boxes[order[i]].center());
+        cmax = fcl::max(cmax, boxes[order[i]].center());
+    }
+    if (end - begin <= leaf_size) {
+        node.first = begin;
+        node.count = end - begin;
+        nodes[index] = node;
+        return index;
+    }
+
+    /* median split along the longest extent of the centers */
+    const fcl::Vec3f extent(cmax - cmin);
+    int axis(0);
+    if (extent[1] > extent[axis]) {
+        axis = 1;
+    }
+    if (extent[2] > extent[axis]) {
+        axis = 2;
+    }
+    const uint32_t mid(begin + (end - begin) / 2);
+    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, CompareCenters(boxes, axis));
+    Build(begin, mid);
+    node.first = Build(mid, end);
+    node.count = 0;
+    nodes[index] = node;
+    return index;
+}
+
+void
+Compound::computeLocalAABB(void)
+{
+    if (nodes.empty()) {
+        aabb_local = fcl::AABB();
+    } else {
+        aabb_local = nodes[0].box;
+    }
+    aabb_center = aabb_local.center();
+    aabb_radius = (aabb_local.min_ - aabb_center).length();
+}
+
+fcl::NODE_TYPE
+Compound::getNodeType(void) const
+{
+    return fcl::NODE_TYPE(GEOM_COMPOUND);
+}
+
+void
+Compound::Query(const fcl::AABB& box, std::vector<uint32_t>& result) const
+{
+    if (nodes.empty()) {
+        return;
+    }
+    uint32_t stack[64];
+    int iStackSize(0);
+    stack[iStackSize++] = 0;
+    while (iStackSize > 0) {
+        const uint32_t index(stack[--iStackSize]);
+        const Node& node(nodes[index]);
+        if (!node.box.overlap(box)) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                if (boxes[order[i]].overlap(box)) {
+                    result.push_back(order[i]);
+                }
+            }
+        } else {
+            stack[iStackSize++] = node.first;
+            stack[iStackSize++] = index + 1;
+        }
+    }
+}
+
+fcl::CollisionObject*
+Compound::GetChild(uint32_t i, const fcl::Transform3f& tf) const
+{
+    fcl::CollisionObject* pChild(children[i]);
+    const fcl::Transform3f child_tf(tf * transforms[i]);
+    pChild->setTransform(child_tf.getRotation(), child_tf.getTranslation());
+    pChild->computeAABB();
+    return pChild;
+}
+
+} // FCL
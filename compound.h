@@ -0,0 +1,51 @@
+#ifndef COMPOUND_H
+#define COMPOUND_H
+
+#include <vector>
+#include <stdint.h>
+#include <fcl/shape/geometric_shapes.h>
+#include <fcl/collision_object.h>
+
+namespace FCL
+{
+
+/* bounds of box carried by the rigid transform tf */
+fcl::AABB TransformAABB(const fcl::AABB& box, const fcl::Transform3f& tf);
+
+/*
+ * Several shapes fixed in the local frame of one collision object, bounded
+ * together so that the broadphase sees a single entry.  The children are
+ * kept in a small BVH of their bounds, stored depth first like Mesh, so the
+ * narrowphase only visits the children that overlap the other object.
+ */
+class Compound : public fcl::ShapeBase {
+public:
+    struct Node {
+        fcl::AABB box;
+        uint32_t first;
+        uint32_t count;
+    };
+private:
+    std::vector<fcl::CollisionObject*> children;
+    std::vector<fcl::Transform3f> transforms;
+    std::vector<fcl::AABB> boxes;
+    std::vector<uint32_t> order;
+    std::vector<Node> nodes;
+    uint32_t Build(uint32_t begin, uint32_t end);
+public:
+    Compound(void);
+    ~Compound(void);
+    /* tf places the child in the compound frame; Setup must follow the last Add */
+    void Add(const boost::shared_ptr<fcl::CollisionGeometry>& geometry, const fcl::Transform3f& tf);
+    void Setup(void);
+    void computeLocalAABB(void);
+    fcl::NODE_TYPE getNodeType(void) const;
+    /* appends the children whose bounds overlap box, in local coordinates */
+    void Query(const fcl::AABB& box, std::vector<uint32_t>& result) const;
+    /* child i, moved to where it is when the compound is at tf */
+    fcl::CollisionObject* GetChild(uint32_t i, const fcl::Transform3f& tf) const;
+};
+
+} // FCL
+
+#endif
@@ -0,0 +1,76 @@
+#include "mbconfig.h"           /* This goes first in every *.c,*.cc file */
+
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "contactstream.h"
+
+ContactStream::ContactStream(const std::string& name, uint64_t capacity)
+: name(name),
+pMap(MAP_FAILED),
+map_size(sizeof(ContactStreamHeader) + capacity * sizeof(ContactStreamRecord)),
+pHeader(NULL),
+pRecords(NULL),
+head(0)
+{
+    if (capacity == 0) {
+        throw std::runtime_error("contact stream \"" + name + "\" needs a positive capacity");
+    }
+    const int fd(shm_open(name.c_str(), O_CREAT | O_RDWR, 0644));
+    if (fd == -1) {
+        throw std::runtime_error("unable to open shared memory object \"" + name + "\"");
+    }
+    if (ftruncate(fd, map_size) == -1) {
+        close(fd);
+        throw std::runtime_error("unable to size shared memory object \"" + name + "\"");
+    }
+    pMap = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED) {
+        throw std::runtime_error("unable to map shared memory object \"" + name + "\"");
+    }
+    std::memset(pMap, 0, map_size);
+    pHeader = static_cast<ContactStreamHeader*>(pMap);
+    pRecords = reinterpret_cast<ContactStreamRecord*>(pHeader + 1);
+    pHeader->version = 1;
+    pHeader->record_size = sizeof(ContactStreamRecord);
+    pHeader->capacity = capacity;
+
+    /* readers load the magic first and then the fields above, which it releases */
+    uint64_t magic;
+    std::memcpy(&magic, "MBDCNTS", 8);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(reinterpret_cast<uint64_t*>(pHeader->magic), magic, __ATOMIC_RELAXED);
+}
+
+ContactStream::~ContactStream(void)
+{
+    if (pMap != MAP_FAILED) {
+        munmap(pMap, map_size);
+        shm_unlink(name.c_str());
+    }
+}
+
+void
+ContactStream::Publish(const ContactStreamRecord& record)
+{
+    ContactStreamRecord* pSlot(pRecords + head % pHeader->capacity);
+    __atomic_store_n(&pSlot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    std::memcpy(reinterpret_cast<char*>(pSlot) + sizeof(pSlot->seq),
+        reinterpret_cast<const char*>(&record) + sizeof(record.seq),
+        sizeof(record) - sizeof(record.seq));
+    head++;
+    __atomic_store_n(&pSlot->seq, head, __ATOMIC_RELEASE);
+    __atomic_store_n(&pHeader->head, head, __ATOMIC_RELEASE);
+}
+
+void
+ContactStream::EndStep(uint64_t step)
+{
+    __atomic_store_n(&pHeader->step, step, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,62 @@
+#ifndef CONTACTSTREAM_H
+#define CONTACTSTREAM_H
+
+#include <string>
+#include <stdint.h>
+
+/*
+ * Converged contacts published into a POSIX shared memory object as a ring of
+ * fixed size records, for live viewers.  The object starts with a 64-byte
+ * ContactStreamHeader followed by capacity ContactStreamRecords, all in native
+ * byte order.
+ *
+ * There is one writer and it never waits: once the ring is full it overwrites
+ * the oldest record.  Record i (counting from 0) lives in slot i % capacity and
+ * its seq is i + 1 once complete, 0 while it is being written.  A reader copies
+ * a record and accepts it if seq reads i + 1 both before and after the copy;
+ * a reader that falls more than capacity records behind skips ahead.
+ * head is the number of records published so far, and step the last step
+ * whose records are all published.
+ */
+struct ContactStreamHeader {
+    char magic[8];              /* "MBDCNTS" */
+    uint32_t version;           /* 1 */
+    uint32_t record_size;       /* sizeof(ContactStreamRecord) */
+    uint64_t capacity;
+    uint64_t head;
+    uint64_t step;
+    uint64_t reserved[3];
+};
+
+struct ContactStreamRecord {
+    uint64_t seq;
+    uint64_t step;              /* converged step, from 1 */
+    double time;
+    uint32_t label1;            /* structural node labels */
+    uint32_t label2;
+    uint32_t index;             /* contact index within the step, and number of contacts in the step */
+    uint32_t count;
+    double f1[3];               /* contact point offsets in the node frames */
+    double f2[3];
+    double Ft[3];               /* friction force on node 1, global frame */
+    double Fn;                  /* normal force */
+    double depth;               /* penetration, net of any margin */
+};
+
+class ContactStream {
+private:
+    std::string name;
+    void* pMap;
+    std::size_t map_size;
+    ContactStreamHeader* pHeader;
+    ContactStreamRecord* pRecords;
+    uint64_t head;
+public:
+    ContactStream(const std::string& name, uint64_t capacity);
+    ~ContactStream(void);
+    /* seq is assigned here */
+    void Publish(const ContactStreamRecord& record);
+    void EndStep(uint64_t step);
+};
+
+#endif
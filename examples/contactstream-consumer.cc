@@ -0,0 +1,93 @@
+/*
+ * Example reader of the collision world contact stream; prints one line per
+ * contact as it is published.  Build with
+ *
+ *     g++ -I.. -o contactstream-consumer contactstream-consumer.cc -lrt
+ *
+ * and run as contactstream-consumer <shm_name>, e.g. /mbdyn-contacts.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "contactstream.h"
+
+int
+main(int argc, char* argv[])
+{
+    if (argc != 2) {
+        std::fprintf(stderr, "usage: %s <shm_name>\n", argv[0]);
+        return 1;
+    }
+    const int fd(shm_open(argv[1], O_RDONLY, 0));
+    if (fd == -1) {
+        std::perror(argv[1]);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || std::size_t(st.st_size) < sizeof(ContactStreamHeader)) {
+        std::fprintf(stderr, "%s: not a contact stream\n", argv[1]);
+        return 1;
+    }
+    void* pMap(mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0));
+    close(fd);
+    if (pMap == MAP_FAILED) {
+        std::perror(argv[1]);
+        return 1;
+    }
+    const ContactStreamHeader* pHeader(static_cast<const ContactStreamHeader*>(pMap));
+    const ContactStreamRecord* pRecords(reinterpret_cast<const ContactStreamRecord*>(pHeader + 1));
+    /* the writer stores the magic last, so the other fields are read after it */
+    uint64_t magic, expected;
+    std::memcpy(&expected, "MBDCNTS", 8);
+    magic = __atomic_load_n(reinterpret_cast<const uint64_t*>(pHeader->magic), __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (magic != expected || pHeader->version != 1
+        || pHeader->record_size != sizeof(ContactStreamRecord)
+        || std::size_t(st.st_size) < sizeof(ContactStreamHeader) + pHeader->capacity * sizeof(ContactStreamRecord)) {
+        std::fprintf(stderr, "%s: not a contact stream\n", argv[1]);
+        return 1;
+    }
+    const uint64_t capacity(pHeader->capacity);
+
+    /* start from the oldest record still in the ring */
+    uint64_t next(__atomic_load_n(&pHeader->head, __ATOMIC_ACQUIRE));
+    next = next > capacity ? next - capacity : 0;
+    uint64_t lost(0);
+    for (;;) {
+        const uint64_t head(__atomic_load_n(&pHeader->head, __ATOMIC_ACQUIRE));
+        if (next == head) {
+            usleep(1000);
+            continue;
+        }
+        if (head - next > capacity) {
+            lost += head - capacity - next;
+            next = head - capacity;
+        }
+        const ContactStreamRecord* pSlot(pRecords + next % capacity);
+        ContactStreamRecord record;
+        const uint64_t seq(__atomic_load_n(&pSlot->seq, __ATOMIC_ACQUIRE));
+        std::memcpy(&record, pSlot, sizeof(record));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (seq != next + 1 || __atomic_load_n(&pSlot->seq, __ATOMIC_RELAXED) != seq) {
+            /* overwritten while copying: the writer is ahead, catch up on the next pass */
+            lost++;
+            next++;
+            continue;
+        }
+        std::printf("%llu %g %u %u %u/%u %g %g %g %g %g\n",
+            (unsigned long long)record.step, record.time, record.label1, record.label2,
+            record.index + 1, record.count, record.Fn, record.Ft[0], record.Ft[1], record.Ft[2], record.depth);
+        std::fflush(stdout);
+        if (lost > 0) {
+            std::fprintf(stderr, "%llu records lost\n", (unsigned long long)lost);
+            lost = 0;
+        }
+        next++;
+    }
+    return 0;
+}
@@ -0,0 +1,322 @@
+#include "mbconfig.h"           /* This goes first in every *.c,*.cc file */
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdlib>
+#ifdef USE_MULTITHREAD
+#include <pthread.h>
+#endif
+
+#include "gridbroadphase.h"
+
+namespace FCL
+{
+
+GridCollisionManager::GridCollisionManager(unsigned num_threads)
+: num_threads(std::max(num_threads, 1u)),
+cell_size(1.0),
+table_mask(0)
+{
+    thread_pairs.resize(this->num_threads);
+}
+
+GridCollisionManager::~GridCollisionManager(void)
+{
+}
+
+std::size_t
+GridCollisionManager::Key(long x, long y, long z) const
+{
+    const std::size_t h((std::size_t(x) * 73856093u) ^ (std::size_t(y) * 19349663u) ^ (std::size_t(z) * 83492791u));
+    return h & table_mask;
+}
+
+void
+GridCollisionManager::Bin(void)
+{
+    const std::size_t N(objects.size());
+    cell_size = 0.0;
+    for (std::size_t i = 0; i < N; i++) {
+        const fcl::AABB& aabb(objects[i]->getAABB());
+        cell_size = std::max(cell_size, std::max(aabb.width(), std::max(aabb.height(), aabb.depth())));
+    }
+    if (!(cell_size > 0.0)) {
+        cell_size = 1.0;
+    }
+    std::size_t M(1);
+    while (M < 2 * N) {
+        M <<= 1;
+    }
+    table_mask = M - 1;
+    cells.resize(N);
+    keys.resize(N);
+    for (std::size_t i = 0; i < N; i++) {
+        const fcl::Vec3f c(objects[i]->getAABB().center());
+        cells[i].x = long(std::floor(c[0] / cell_size));
+        cells[i].y = long(std::floor(c[1] / cell_size));
+        cells[i].z = long(std::floor(c[2] / cell_size));
+        keys[i] = Key(cells[i].x, cells[i].y, cells[i].z);
+    }
+
+    /* counting sort by cell key; cell_start[k] ends up as the first slot of key k */
+    cell_start.assign(M + 1, 0);
+    for (std::size_t i = 0; i < N; i++) {
+        cell_start[keys[i] + 1]++;
+    }
+    for (std::size_t k = 1; k <= M; k++) {
+        cell_start[k] += cell_start[k - 1];
+    }
+    sorted.resize(N);
+    for (std::size_t i = 0; i < N; i++) {
+        sorted[cell_start[keys[i]]++] = i;
+    }
+    for (std::size_t k = M; k > 0; k--) {
+        cell_start[k] = cell_start[k - 1];
+    }
+    cell_start[0] = 0;
+}
+
+void
+GridCollisionManager::EmitPairs(std::size_t begin, std::size_t end,
+    std::vector<std::pair<fcl::CollisionObject*, fcl::CollisionObject*> >& pairs) const
+{
+    pairs.clear();
+    for (std::size_t i = begin; i < end; i++) {
+        const Cell& c(cells[i]);
+        const fcl::AABB& aabb(objects[i]->getAABB());
+        std::size_t visited[27];
+        int iNumVisited(0);
+        for (long dx = -1; dx <= 1; dx++) {
+            for (long dy = -1; dy <= 1; dy++) {
+                for (long dz = -1; dz <= 1; dz++) {
+                    const std::size_t k(Key(c.x + dx, c.y + dy, c.z + dz));
+                    /* neighbor cells may share a hashed key; visit each bucket once */
+                    if (std::find(visited, visited + iNumVisited, k) != visited + iNumVisited) {
+                        continue;
+                    }
+                    visited[iNumVisited++] = k;
+                    for (std::size_t s = cell_start[k]; s < cell_start[k + 1]; s++) {
+                        const std::size_t j(sorted[s]);
+                        if (j <= i
+                            || std::labs(cells[j].x - c.x) > 1
+                            || std::labs(cells[j].y - c.y) > 1
+                            || std::labs(cells[j].z - c.z) > 1) {
+                            continue;
+                        }
+                        if (aabb.overlap(objects[j]->getAABB())) {
+                            pairs.push_back(std::make_pair(objects[i], objects[j]));
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void*
+GridCollisionManager::EmitPairsThread(void* arg)
+{
+    ThreadData* pData(static_cast<ThreadData*>(arg));
+    pData->pManager->EmitPairs(pData->begin, pData->end, *pData->pPairs);
+    return NULL;
+}
+
+void
+GridCollisionManager::registerObject(fcl::CollisionObject* obj)
+{
+    if (obj->getNodeType() == fcl::GEOM_SPHERE) {
+        objects.push_back(obj);
+    } else {
+        large_objects.push_back(obj);
+    }
+}
+
+void
+GridCollisionManager::unregisterObject(fcl::CollisionObject* obj)
+{
+    objects.erase(std::remove(objects.begin(), objects.end(), obj), objects.end());
+    large_objects.erase(std::remove(large_objects.begin(), large_objects.end(), obj), large_objects.end());
+}
+
+void
+GridCollisionManager::setup(void)
+{
+    Bin();
+}
+
+void
+GridCollisionManager::update(void)
+{
+    Bin();
+}
+
+void
+GridCollisionManager::update(fcl::CollisionObject* updated_obj)
+{
+    Bin();
+}
+
+void
+GridCollisionManager::update(const std::vector<fcl::CollisionObject*>& updated_objs)
+{
+    /* rebinning is linear in the number of objects, no cheaper partial update */
+    Bin();
+}
+
+void
+GridCollisionManager::clear(void)
+{
+    objects.clear();
+    large_objects.clear();
+    Bin();
+}
+
+void
+GridCollisionManager::getObjects(std::vector<fcl::CollisionObject*>& objs) const
+{
+    objs.assign(objects.begin(), objects.end());
+    objs.insert(objs.end(), large_objects.begin(), large_objects.end());
+}
+
+void
+GridCollisionManager::collide(fcl::CollisionObject* obj, void* cdata, fcl::CollisionCallBack callback) const
+{
+    std::vector<fcl::CollisionObject*> objs;
+    getObjects(objs);
+    for (std::vector<fcl::CollisionObject*>::const_iterator it = objs.begin(); it != objs.end(); it++) {
+        if (*it != obj && obj->getAABB().overlap((*it)->getAABB())) {
+            if (callback(obj, *it, cdata)) {
+                return;
+            }
+        }
+    }
+}
+
+void
+GridCollisionManager::distance(fcl::CollisionObject* obj, void* cdata, fcl::DistanceCallBack callback) const
+{
+    std::vector<fcl::CollisionObject*> objs;
+    getObjects(objs);
+    fcl::FCL_REAL min_dist(std::numeric_limits<fcl::FCL_REAL>::max());
+    for (std::vector<fcl::CollisionObject*>::const_iterator it = objs.begin(); it != objs.end(); it++) {
+        if (*it != obj && callback(obj, *it, cdata, min_dist)) {
+            return;
+        }
+    }
+}
+
+void
+GridCollisionManager::collide(void* cdata, fcl::CollisionCallBack callback) const
+{
+    const std::size_t N(objects.size());
+#ifdef USE_MULTITHREAD
+    if (num_threads > 1 && N >= num_threads) {
+        std::vector<pthread_t> threads(num_threads);
+        std::vector<ThreadData> data(num_threads);
+        for (unsigned t = 0; t < num_threads; t++) {
+            data[t].pManager = this;
+            data[t].begin = (N * t) / num_threads;
+            data[t].end = (N * (t + 1)) / num_threads;
+            data[t].pPairs = &thread_pairs[t];
+        }
+        for (unsigned t = 1; t < num_threads; t++) {
+            if (pthread_create(&threads[t], NULL, EmitPairsThread, &data[t]) != 0) {
+                /* could not spawn, do the chunk here */
+                EmitPairsThread(&data[t]);
+                threads[t] = pthread_self();
+            }
+        }
+        EmitPairsThread(&data[0]);
+        for (unsigned t = 1; t < num_threads; t++) {
+            if (!pthread_equal(threads[t], pthread_self())) {
+                pthread_join(threads[t], NULL);
+            }
+        }
+    } else
+#endif
+    {
+        EmitPairs(0, N, thread_pairs[0]);
+        for (unsigned t = 1; t < num_threads; t++) {
+            thread_pairs[t].clear();
+        }
+    }
+    for (unsigned t = 0; t < num_threads; t++) {
+        for (std::vector<std::pair<fcl::CollisionObject*, fcl::CollisionObject*> >::const_iterator it = thread_pairs[t].begin();
+            it != thread_pairs[t].end(); it++) {
+            if (callback(it->first, it->second, cdata)) {
+                return;
+            }
+        }
+    }
+    for (std::size_t a = 0; a < large_objects.size(); a++) {
+        const fcl::AABB& aabb(large_objects[a]->getAABB());
+        for (std::size_t i = 0; i < N; i++) {
+            if (aabb.overlap(objects[i]->getAABB()) && callback(large_objects[a], objects[i], cdata)) {
+                return;
+            }
+        }
+        for (std::size_t b = a + 1; b < large_objects.size(); b++) {
+            if (aabb.overlap(large_objects[b]->getAABB()) && callback(large_objects[a], large_objects[b], cdata)) {
+                return;
+            }
+        }
+    }
+}
+
+void
+GridCollisionManager::distance(void* cdata, fcl::DistanceCallBack callback) const
+{
+    std::vector<fcl::CollisionObject*> objs;
+    getObjects(objs);
+    fcl::FCL_REAL min_dist(std::numeric_limits<fcl::FCL_REAL>::max());
+    for (std::size_t a = 0; a < objs.size(); a++) {
+        for (std::size_t b = a + 1; b < objs.size(); b++) {
+            if (callback(objs[a], objs[b], cdata, min_dist)) {
+                return;
+            }
+        }
+    }
+}
+
+void
+GridCollisionManager::collide(fcl::BroadPhaseCollisionManager* other_manager, void* cdata, fcl::CollisionCallBack callback) const
+{
+    if (other_manager == this) {
+        collide(cdata, callback);
+        return;
+    }
+    std::vector<fcl::CollisionObject*> objs;
+    other_manager->getObjects(objs);
+    for (std::vector<fcl::CollisionObject*>::const_iterator it = objs.begin(); it != objs.end(); it++) {
+        collide(*it, cdata, callback);
+    }
+}
+
+void
+GridCollisionManager::distance(fcl::BroadPhaseCollisionManager* other_manager, void* cdata, fcl::DistanceCallBack callback) const
+{
+    if (other_manager == this) {
+        distance(cdata, callback);
+        return;
+    }
+    std::vector<fcl::CollisionObject*> objs;
+    other_manager->getObjects(objs);
+    for (std::vector<fcl::CollisionObject*>::const_iterator it = objs.begin(); it != objs.end(); it++) {
+        distance(*it, cdata, callback);
+    }
+}
+
+bool
+GridCollisionManager::empty(void) const
+{
+    return objects.empty() && large_objects.empty();
+}
+
+size_t
+GridCollisionManager::size(void) const
+{
+    return objects.size() + large_objects.size();
+}
+
+} // FCL
@@ -0,0 +1,71 @@
+#ifndef GRIDBROADPHASE_H
+#define GRIDBROADPHASE_H
+
+#include <vector>
+#include <fcl/broadphase/broadphase.h>
+
+namespace FCL
+{
+
+/*
+ * Uniform grid broadphase for granular media.
+ *
+ * Spheres are binned by the cell of their AABB center, with cells sized to the
+ * largest binned AABB, and sorted into a cell list by counting sort on a hashed
+ * cell key.  Candidate pairs are emitted from the 27 neighbor cells of each
+ * sphere, split over worker threads, and then handed to the callback serially
+ * in the order a single thread would produce them.  Any other shape is kept
+ * aside as a large object and tested against everything by AABB overlap.
+ */
+class GridCollisionManager : public fcl::BroadPhaseCollisionManager {
+private:
+    struct Cell {
+        long x;
+        long y;
+        long z;
+    };
+    struct ThreadData {
+        const GridCollisionManager* pManager;
+        std::size_t begin;
+        std::size_t end;
+        std::vector<std::pair<fcl::CollisionObject*, fcl::CollisionObject*> >* pPairs;
+    };
+    std::vector<fcl::CollisionObject*> objects;
+    std::vector<fcl::CollisionObject*> large_objects;
+    unsigned num_threads;
+    fcl::FCL_REAL cell_size;
+    std::size_t table_mask;
+    std::vector<Cell> cells;
+    std::vector<std::size_t> keys;
+    std::vector<std::size_t> cell_start;
+    std::vector<std::size_t> sorted;
+    mutable std::vector<std::vector<std::pair<fcl::CollisionObject*, fcl::CollisionObject*> > > thread_pairs;
+    std::size_t Key(long x, long y, long z) const;
+    void Bin(void);
+    void EmitPairs(std::size_t begin, std::size_t end,
+        std::vector<std::pair<fcl::CollisionObject*, fcl::CollisionObject*> >& pairs) const;
+    static void* EmitPairsThread(void* arg);
+public:
+    GridCollisionManager(unsigned num_threads = 1);
+    ~GridCollisionManager(void);
+    void registerObject(fcl::CollisionObject* obj);
+    void unregisterObject(fcl::CollisionObject* obj);
+    void setup(void);
+    void update(void);
+    void update(fcl::CollisionObject* updated_obj);
+    void update(const std::vector<fcl::CollisionObject*>& updated_objs);
+    void clear(void);
+    void getObjects(std::vector<fcl::CollisionObject*>& objs) const;
+    void collide(fcl::CollisionObject* obj, void* cdata, fcl::CollisionCallBack callback) const;
+    void distance(fcl::CollisionObject* obj, void* cdata, fcl::DistanceCallBack callback) const;
+    void collide(void* cdata, fcl::CollisionCallBack callback) const;
+    void distance(void* cdata, fcl::DistanceCallBack callback) const;
+    void collide(fcl::BroadPhaseCollisionManager* other_manager, void* cdata, fcl::CollisionCallBack callback) const;
+    void distance(fcl::BroadPhaseCollisionManager* other_manager, void* cdata, fcl::DistanceCallBack callback) const;
+    bool empty(void) const;
+    size_t size(void) const;
+};
+
+} // FCL
+
+#endif
@@ -0,0 +1,109 @@
+#include "mbconfig.h"           /* This goes first in every *.c,*.cc file */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "intersect.h"
+#include "mappedfile.h"
+
+namespace FCL
+{
+
+namespace
+{
+const std::size_t header_size(64);
+}
+
+Heightfield::Heightfield(const std::string& file_name)
+: pMap(MAP_FAILED),
+map_size(0),
+pHeights(NULL)
+{
+    MappedFile file(file_name);
+    if (file.p == MAP_FAILED) {
+        throw std::runtime_error("unable to map heightfield file \"" + file_name + "\"");
+    }
+    if (file.size < header_size) {
+        throw std::runtime_error("heightfield file \"" + file_name + "\" is truncated");
+    }
+    const char* p(static_cast<const char*>(file.p));
+    uint32_t n[2];
+    double header[6];
+    std::memcpy(n, p + 4, sizeof(n));
+    std::memcpy(header, p + 16, sizeof(header));
+    nx = n[0];
+    ny = n[1];
+    x0 = header[0];
+    y0 = header[1];
+    dx = header[2];
+    dy = header[3];
+    zmin = header[4];
+    zmax = header[5];
+    if (std::memcmp(p, "HFLD", 4) != 0 || nx < 2 || ny < 2 || !(dx > 0.0) || !(dy > 0.0) || zmax < zmin
+        || file.size != header_size + std::size_t(nx) * std::size_t(ny) * sizeof(double)) {
+        throw std::runtime_error("heightfield file \"" + file_name + "\" has an invalid header");
+    }
+    pHeights = reinterpret_cast<const double*>(p + header_size);
+    pMap = file.p;
+    map_size = file.size;
+    file.Release();
+    computeLocalAABB();
+}
+
+Heightfield::~Heightfield(void)
+{
+    if (pMap != MAP_FAILED) {
+        munmap(pMap, map_size);
+    }
+}
+
+void
+Heightfield::computeLocalAABB(void)
+{
+    aabb_local = fcl::AABB(fcl::Vec3f(x0, y0, zmin), fcl::Vec3f(x0 + (nx - 1) * dx, y0 + (ny - 1) * dy, zmax));
+    aabb_center = aabb_local.center();
+    aabb_radius = (aabb_local.min_ - aabb_center).length();
+}
+
+fcl::NODE_TYPE
+Heightfield::getNodeType(void) const
+{
+    return fcl::NODE_TYPE(GEOM_HEIGHTFIELD);
+}
+
+fcl::FCL_REAL
+Heightfield::GetCellSize(void) const
+{
+    return std::min(dx, dy);
+}
+
+bool
+Heightfield::Surface(fcl::FCL_REAL x, fcl::FCL_REAL y, fcl::FCL_REAL& h, fcl::Vec3f& normal) const
+{
+    const fcl::FCL_REAL gx((x - x0) / dx);
+    const fcl::FCL_REAL gy((y - y0) / dy);
+    if (!(gx >= 0.0 && gx <= nx - 1 && gy >= 0.0 && gy <= ny - 1)) {
+        return false;
+    }
+    const unsigned i(std::min(unsigned(gx), nx - 2));
+    const unsigned j(std::min(unsigned(gy), ny - 2));
+    const fcl::FCL_REAL s(gx - i);
+    const fcl::FCL_REAL t(gy - j);
+    const double* row(pHeights + std::size_t(j) * nx + i);
+    const fcl::FCL_REAL h00(row[0]);
+    const fcl::FCL_REAL h10(row[1]);
+    const fcl::FCL_REAL h01(row[nx]);
+    const fcl::FCL_REAL h11(row[nx + 1]);
+    h = h00 * (1.0 - s) * (1.0 - t) + h10 * s * (1.0 - t) + h01 * (1.0 - s) * t + h11 * s * t;
+    const fcl::FCL_REAL dhdx(((h10 - h00) * (1.0 - t) + (h11 - h01) * t) / dx);
+    const fcl::FCL_REAL dhdy(((h01 - h00) * (1.0 - s) + (h11 - h10) * s) / dy);
+    normal.setValue(-dhdx, -dhdy, 1.0);
+    normal.normalize();
+    return true;
+}
+
+} // FCL
@@ -0,0 +1,48 @@
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+#include <string>
+#include <fcl/shape/geometric_shapes.h>
+
+namespace FCL
+{
+
+/*
+ * Terrain z = h(x, y) sampled on a regular grid, in the local frame of the
+ * collision object.  The grid is read from a binary file that is memory-mapped,
+ * laid out in native byte order as
+ *
+ *     char     magic[4] = "HFLD"
+ *     uint32   nx, ny, (reserved, 0)
+ *     float64  x0, y0, dx, dy, zmin, zmax
+ *     float64  h[ny][nx]          height of node (x0 + i dx, y0 + j dy) at h[j][i]
+ *
+ * Lookup finds the cell directly from (x, y), so its cost does not depend on
+ * the size of the terrain.
+ */
+class Heightfield : public fcl::ShapeBase {
+private:
+    void* pMap;
+    std::size_t map_size;
+    const double* pHeights;
+    unsigned nx;
+    unsigned ny;
+    fcl::FCL_REAL x0;
+    fcl::FCL_REAL y0;
+    fcl::FCL_REAL dx;
+    fcl::FCL_REAL dy;
+    fcl::FCL_REAL zmin;
+    fcl::FCL_REAL zmax;
+public:
+    Heightfield(const std::string& file_name);
+    ~Heightfield(void);
+    void computeLocalAABB(void);
+    fcl::NODE_TYPE getNodeType(void) const;
+    fcl::FCL_REAL GetCellSize(void) const;
+    /* interpolated height and upward unit normal at local (x, y); false outside the grid */
+    bool Surface(fcl::FCL_REAL x, fcl::FCL_REAL y, fcl::FCL_REAL& h, fcl::Vec3f& normal) const;
+};
+
+} // FCL
+
+#endif
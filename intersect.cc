@@ -1,49 +1,611 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 #include "intersect.h"
 
 namespace FCL
 {
 
 void
-Intersect(const fcl::Sphere* s1, const fcl::Transform3f& tf1, const fcl::Sphere* s2, const fcl::Transform3f& tf2, Vec3f_pairs& Rf_pairs)
+Intersect(const fcl::Sphere* s1, const fcl::Transform3f& tf1, const fcl::Sphere* s2, const fcl::Transform3f& tf2,
+    fcl::FCL_REAL margin, Vec3f_pairs& Rf_pairs)
 {
+    const fcl::FCL_REAL r1(s1->radius + margin);
     const fcl::Vec3f normal(tf2.getTranslation() - tf1.getTranslation());
-    if (normal.length() < s1->radius + s2->radius) {
-        Rf_pairs.push_back(std::make_pair(tf1.getTranslation() + normal * (s1->radius / normal.length()), tf2.getTranslation() - normal * (s2->radius / normal.length())));
+    if (normal.length() < r1 + s2->radius) {
+        Rf_pairs.push_back(std::make_pair(tf1.getTranslation() + normal * (r1 / normal.length()), tf2.getTranslation() - normal * (s2->radius / normal.length())));
     }
 }
 
 void
-Intersect(const fcl::Sphere* s1, const fcl::Transform3f& tf1, const fcl::Plane* s2, const fcl::Transform3f& tf2, Vec3f_pairs& Rf_pairs)
+Intersect(const fcl::Sphere* s1, const fcl::Transform3f& tf1, const fcl::Plane* s2, const fcl::Transform3f& tf2,
+    fcl::FCL_REAL margin, Vec3f_pairs& Rf_pairs)
 {
+    const fcl::FCL_REAL r1(s1->radius + margin);
     const fcl::Plane new_s2 = fcl::transform(*s2, tf2);
     const fcl::FCL_REAL signed_dist = new_s2.signedDistance(tf1.getTranslation());
-    if (std::abs(signed_dist) < s1->radius) {
-       Rf_pairs.push_back(std::make_pair(tf1.getTranslation() - new_s2.n * s1->radius, tf1.getTranslation() - new_s2.n * signed_dist));
+    if (std::abs(signed_dist) < r1) {
+       Rf_pairs.push_back(std::make_pair(tf1.getTranslation() - new_s2.n * r1, tf1.getTranslation() - new_s2.n * signed_dist));
+    }
+}
+
+void
+Intersect(const fcl::Vec3f& c1, fcl::FCL_REAL r1, const fcl::Vec3f& c2, fcl::FCL_REAL r2, Vec3f_pairs& Rf_pairs)
+{
+    const fcl::Vec3f normal(c2 - c1);
+    const fcl::FCL_REAL distance(normal.length());
+    if (distance < r1 + r2 && distance > 0.0) {
+        Rf_pairs.push_back(std::make_pair(c1 + normal * (r1 / distance), c2 - normal * (r2 / distance)));
+    }
+}
+
+void
+CapsuleSegment(const fcl::Capsule* s, const fcl::Transform3f& tf, fcl::Vec3f& a, fcl::Vec3f& b)
+{
+    a = tf.transform(fcl::Vec3f(0., 0., -0.5 * s->lz));
+    b = tf.transform(fcl::Vec3f(0., 0., 0.5 * s->lz));
+}
+
+void
+Intersect(const fcl::Sphere* s1, const fcl::Transform3f& tf1, const fcl::Capsule* s2, const fcl::Transform3f& tf2,
+    fcl::FCL_REAL margin, Vec3f_pairs& Rf_pairs)
+{
+    const fcl::FCL_REAL r1(s1->radius + margin);
+    fcl::Vec3f a, b;
+    CapsuleSegment(s2, tf2, a, b);
+    const fcl::Vec3f c(tf1.getTranslation());
+    const fcl::Vec3f ab(b - a);
+    const fcl::FCL_REAL t(std::max(0.0, std::min(1.0, (c - a).dot(ab) / ab.dot(ab))));
+    Intersect(c, r1, a + ab * t, s2->radius, Rf_pairs);
+}
+
+void
+Intersect(const fcl::Capsule* s1, const fcl::Transform3f& tf1, const fcl::Plane* s2, const fcl::Transform3f& tf2,
+    fcl::FCL_REAL margin, Vec3f_pairs& Rf_pairs)
+{
+    const fcl::FCL_REAL r1(s1->radius + margin);
+    fcl::Vec3f ends[2];
+    CapsuleSegment(s1, tf1, ends[0], ends[1]);
+    const fcl::Plane new_s2 = fcl::transform(*s2, tf2);
+    for (int i = 0; i < 2; i++) {
+        const fcl::FCL_REAL signed_dist = new_s2.signedDistance(ends[i]);
+        if (std::abs(signed_dist) < r1) {
+            Rf_pairs.push_back(std::make_pair(ends[i] - new_s2.n * r1, ends[i] - new_s2.n * signed_dist));
+        }
+    }
+}
+
+bool
+Penetration(const fcl::Vec3f& c, fcl::FCL_REAL r, const Heightfield* s2, const fcl::Transform3f& tf2,
+    fcl::FCL_REAL& penetration, std::pair<fcl::Vec3f, fcl::Vec3f>& pt_pair)
+{
+    /* c is in the terrain frame; distance from the tangent plane at the point below it */
+    fcl::FCL_REAL h;
+    fcl::Vec3f n;
+    if (!s2->Surface(c[0], c[1], h, n)) {
+        return false;
+    }
+    const fcl::FCL_REAL signed_dist((c[2] - h) * n[2]);
+    penetration = r - signed_dist;
+    pt_pair = std::make_pair(tf2.transform(c - n * r), tf2.transform(c - n * signed_dist));
+    return true;
+}
+
+/*
+ * Samples the axis a, b of a capsule of radius r, in the frame of s2, at
+ * iNumSamples evenly spaced spheres, and keeps the penetrating ends and the
+ * interior peaks of penetration.  Penetration(c, r, s2, tf2, ...) gives the
+ * depth and the contact points of the sphere at c.
+ */
+template <class T>
+void
+SampleCapsuleAxis(const fcl::Vec3f& a, const fcl::Vec3f& b, fcl::FCL_REAL r, int iNumSamples,
+    const T* s2, const fcl::Transform3f& tf2, Vec3f_pairs& Rf_pairs)
+{
+    std::vector<fcl::FCL_REAL> penetration(iNumSamples, -1.0);
+    Vec3f_pairs samples(iNumSamples);
+    for (int k = 0; k < iNumSamples; k++) {
+        if (!Penetration(a + (b - a) * (fcl::FCL_REAL(k) / (iNumSamples - 1)), r, s2, tf2, penetration[k], samples[k])) {
+            penetration[k] = -1.0;
+        }
+    }
+    for (int k = 0; k < iNumSamples; k++) {
+        if (!(penetration[k] > 0.0)) {
+            continue;
+        }
+        if (k == 0 || k == iNumSamples - 1
+            || (penetration[k] > penetration[k - 1] && penetration[k] > penetration[k + 1])) {
+            Rf_pairs.push_back(samples[k]);
+        }
+    }
+}
+
+void
+Intersect(const fcl::Sphere* s1, const fcl::Transform3f& tf1, const Heightfield* s2, const fcl::Transform3f& tf2,
+    fcl::FCL_REAL margin, Vec3f_pairs& Rf_pairs)
+{
+    const fcl::FCL_REAL r1(s1->radius + margin);
+    const fcl::Vec3f c(tf2.getRotation().transposeDot(tf1.getTranslation() - tf2.getTranslation()));
+    fcl::FCL_REAL penetration;
+    std::pair<fcl::Vec3f, fcl::Vec3f> pt_pair;
+    if (Penetration(c, r1, s2, tf2, penetration, pt_pair) && penetration > 0.0) {
+        Rf_pairs.push_back(pt_pair);
+    }
+}
+
+void
+Intersect(const fcl::Capsule* s1, const fcl::Transform3f& tf1, const Heightfield* s2, const fcl::Transform3f& tf2,
+    fcl::FCL_REAL margin, Vec3f_pairs& Rf_pairs)
+{
+    const fcl::FCL_REAL r1(s1->radius + margin);
+    fcl::Vec3f a, b;
+    CapsuleSegment(s1, tf1, a, b);
+    a = tf2.getRotation().transposeDot(a - tf2.getTranslation());
+    b = tf2.getRotation().transposeDot(b - tf2.getTranslation());
+    const fcl::Vec3f ab(b - a);
+
+    /* at the terrain resolution */
+    const fcl::FCL_REAL horizontal(std::sqrt(ab[0] * ab[0] + ab[1] * ab[1]));
+    SampleCapsuleAxis(a, b, r1, 2 + int(std::ceil(horizontal / s2->GetCellSize())), s2, tf2, Rf_pairs);
+}
+
+fcl::Vec3f
+ClosestPointOnTriangle(const fcl::Vec3f& p, const fcl::Vec3f& a, const fcl::Vec3f& b, const fcl::Vec3f& c)
+{
+    /* Ericson, Real-Time Collision Detection, 5.1.5 */
+    const fcl::Vec3f ab(b - a);
+    const fcl::Vec3f ac(c - a);
+    const fcl::Vec3f ap(p - a);
+    const fcl::FCL_REAL d1(ab.dot(ap));
+    const fcl::FCL_REAL d2(ac.dot(ap));
+    if (d1 <= 0.0 && d2 <= 0.0) {
+        return a;
+    }
+    const fcl::Vec3f bp(p - b);
+    const fcl::FCL_REAL d3(ab.dot(bp));
+    const fcl::FCL_REAL d4(ac.dot(bp));
+    if (d3 >= 0.0 && d4 <= d3) {
+        return b;
+    }
+    const fcl::FCL_REAL vc(d1 * d4 - d3 * d2);
+    if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+        return a + ab * (d1 / (d1 - d3));
+    }
+    const fcl::Vec3f cp(p - c);
+    const fcl::FCL_REAL d5(ab.dot(cp));
+    const fcl::FCL_REAL d6(ac.dot(cp));
+    if (d6 >= 0.0 && d5 <= d6) {
+        return c;
+    }
+    const fcl::FCL_REAL vb(d5 * d2 - d1 * d6);
+    if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+        return a + ac * (d2 / (d2 - d6));
+    }
+    const fcl::FCL_REAL va(d3 * d6 - d5 * d4);
+    if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) {
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+    const fcl::FCL_REAL denom(1.0 / (va + vb + vc));
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+void
+Intersect(const fcl::Vec3f& c, fcl::FCL_REAL r, const Mesh* s2, const fcl::Transform3f& tf2, Vec3f_pairs& Rf_pairs)
+{
+    /* c is in the mesh frame; a point shared by adjacent triangles is reported once */
+    const fcl::Vec3f delta(r, r, r);
+    std::vector<uint32_t> triangles;
+    s2->Query(fcl::AABB(c - delta, c + delta), triangles);
+    const std::size_t first(Rf_pairs.size());
+    const fcl::FCL_REAL tolerance(1e-6 * r);
+    for (std::vector<uint32_t>::const_iterator it = triangles.begin(); it != triangles.end(); it++) {
+        fcl::Vec3f a, b, v;
+        s2->Triangle(*it, a, b, v);
+        const fcl::Vec3f q(ClosestPointOnTriangle(c, a, b, v));
+        const fcl::Vec3f normal(c - q);
+        const fcl::FCL_REAL distance(normal.length());
+        if (!(distance < r && distance > 0.0)) {
+            continue;
+        }
+        const fcl::Vec3f pt2(tf2.transform(q));
+        bool bDuplicate(false);
+        for (std::size_t k = first; k < Rf_pairs.size() && !bDuplicate; k++) {
+            bDuplicate = (Rf_pairs[k].second - pt2).sqrLength() < tolerance * tolerance;
+        }
+        if (!bDuplicate) {
+            Rf_pairs.push_back(std::make_pair(tf2.transform(c - normal * (r / distance)), pt2));
+        }
+    }
+}
+
+void
+Intersect(const fcl::Sphere* s1, const fcl::Transform3f& tf1, const Mesh* s2, const fcl::Transform3f& tf2,
+    fcl::FCL_REAL margin, Vec3f_pairs& Rf_pairs)
+{
+    const fcl::FCL_REAL r1(s1->radius + margin);
+    const fcl::Vec3f c(tf2.getRotation().transposeDot(tf1.getTranslation() - tf2.getTranslation()));
+    Intersect(c, r1, s2, tf2, Rf_pairs);
+}
+
+void
+Intersect(const fcl::Capsule* s1, const fcl::Transform3f& tf1, const Mesh* s2, const fcl::Transform3f& tf2,
+    fcl::FCL_REAL margin, Vec3f_pairs& Rf_pairs)
+{
+    const fcl::FCL_REAL r1(s1->radius + margin);
+    /* the capsule is covered by spheres spaced one radius apart along its axis */
+    fcl::Vec3f a, b;
+    CapsuleSegment(s1, tf1, a, b);
+    a = tf2.getRotation().transposeDot(a - tf2.getTranslation());
+    b = tf2.getRotation().transposeDot(b - tf2.getTranslation());
+    const int iNumSamples(2 + int(std::ceil(s1->lz / s1->radius)));
+    for (int k = 0; k < iNumSamples; k++) {
+        Intersect(a + (b - a) * (fcl::FCL_REAL(k) / (iNumSamples - 1)), r1, s2, tf2, Rf_pairs);
     }
 }
 
+bool
+Penetration(const fcl::Vec3f& c, fcl::FCL_REAL r, const DistanceField* s2, const fcl::Transform3f& tf2,
+    fcl::FCL_REAL& penetration, std::pair<fcl::Vec3f, fcl::Vec3f>& pt_pair)
+{
+    /* c is in the field frame; the surface point is found along the distance gradient */
+    fcl::FCL_REAL d;
+    fcl::Vec3f gradient;
+    if (!s2->Distance(c, d, gradient)) {
+        return false;
+    }
+    const fcl::FCL_REAL length(gradient.length());
+    if (!(length > 0.0)) {
+        return false;
+    }
+    const fcl::Vec3f n(gradient / length);
+    penetration = r - d;
+    pt_pair = std::make_pair(tf2.transform(c - n * r), tf2.transform(c - n * d));
+    return true;
+}
+
+void
+Intersect(const fcl::Sphere* s1, const fcl::Transform3f& tf1, const DistanceField* s2, const fcl::Transform3f& tf2,
+    fcl::FCL_REAL margin, Vec3f_pairs& Rf_pairs)
+{
+    const fcl::FCL_REAL r1(s1->radius + margin);
+    const fcl::Vec3f c(tf2.getRotation().transposeDot(tf1.getTranslation() - tf2.getTranslation()));
+    fcl::FCL_REAL penetration;
+    std::pair<fcl::Vec3f, fcl::Vec3f> pt_pair;
+    if (Penetration(c, r1, s2, tf2, penetration, pt_pair) && penetration > 0.0) {
+        Rf_pairs.push_back(pt_pair);
+    }
+}
+
+void
+Intersect(const fcl::Capsule* s1, const fcl::Transform3f& tf1, const DistanceField* s2, const fcl::Transform3f& tf2,
+    fcl::FCL_REAL margin, Vec3f_pairs& Rf_pairs)
+{
+    const fcl::FCL_REAL r1(s1->radius + margin);
+    fcl::Vec3f a, b;
+    CapsuleSegment(s1, tf1, a, b);
+    a = tf2.getRotation().transposeDot(a - tf2.getTranslation());
+    b = tf2.getRotation().transposeDot(b - tf2.getTranslation());
+
+    /* at the voxel size */
+    SampleCapsuleAxis(a, b, r1, 2 + int(std::ceil((b - a).length() / s2->GetCellSize())), s2, tf2, Rf_pairs);
+}
+
+void
+ReduceContacts(Vec3f_pairs& Rf_pairs, std::size_t max_pairs)
+{
+    const std::size_t n(Rf_pairs.size());
+    if (n <= max_pairs || max_pairs == 0) {
+        return;
+    }
+
+    /* ties go to the lower index, so the same input always gives the same choice */
+    std::size_t deepest(0);
+    fcl::FCL_REAL max_depth(-1.0);
+    for (std::size_t i = 0; i < n; i++) {
+        const fcl::FCL_REAL depth((Rf_pairs[i].second - Rf_pairs[i].first).sqrLength());
+        if (depth > max_depth) {
+            max_depth = depth;
+            deepest = i;
+        }
+    }
+    std::vector<bool> keep(n, false);
+    std::vector<fcl::FCL_REAL> dist(n);
+    keep[deepest] = true;
+    for (std::size_t i = 0; i < n; i++) {
+        dist[i] = (Rf_pairs[i].first - Rf_pairs[deepest].first).sqrLength();
+    }
+    for (std::size_t k = 1; k < max_pairs; k++) {
+        std::size_t farthest(n);
+        for (std::size_t i = 0; i < n; i++) {
+            if (!keep[i] && (farthest == n || dist[i] > dist[farthest])) {
+                farthest = i;
+            }
+        }
+        keep[farthest] = true;
+        for (std::size_t i = 0; i < n; i++) {
+            dist[i] = std::min(dist[i], (Rf_pairs[i].first - Rf_pairs[farthest].first).sqrLength());
+        }
+    }
+
+    /* kept pairs stay in narrowphase order */
+    std::size_t j(0);
+    for (std::size_t i = 0; i < n; i++) {
+        if (keep[i]) {
+            Rf_pairs[j++] = Rf_pairs[i];
+        }
+    }
+    Rf_pairs.resize(j);
+}
+
 template<typename T_SH1, typename T_SH2>
 void
-GenFunc(fcl::CollisionObject* pObject1, fcl::CollisionObject* pObject2, Vec3f_pairs& Rf_pairs)
+GenFunc(fcl::CollisionObject* pObject1, fcl::CollisionObject* pObject2, fcl::FCL_REAL margin,
+    NarrowphaseCache& cache, Vec3f_pairs& Rf_pairs)
 {
     const T_SH1* s1 = static_cast<const T_SH1*>(pObject1->collisionGeometry().get());
     const T_SH2* s2 = static_cast<const T_SH2*>(pObject2->collisionGeometry().get());
-    Intersect(s1, pObject1->getTransform(), s2, pObject2->getTransform(), Rf_pairs);
+    Intersect(s1, pObject1->getTransform(), s2, pObject2->getTransform(), margin, Rf_pairs);
+}
+
+/* rough direction from the first object towards the second */
+template<typename T_SH2>
+fcl::Vec3f
+Towards(const fcl::CollisionObject* pObject1, const T_SH2* s2, const fcl::CollisionObject* pObject2)
+{
+    return pObject2->getAABB().center() - pObject1->getAABB().center();
+}
+
+fcl::Vec3f
+Towards(const fcl::CollisionObject* pObject1, const fcl::Plane* s2, const fcl::CollisionObject* pObject2)
+{
+    return -(pObject2->getRotation() * s2->n);
+}
+
+/* points of a shape that can reach farthest along direction, candidates of a contact patch */
+template<typename T_SH>
+void
+PatchPoints(const T_SH* s, const fcl::Transform3f& tf, const fcl::Vec3f& direction, std::vector<fcl::Vec3f>& points)
+{
+}
+
+void
+PatchPoints(const fcl::Box* s, const fcl::Transform3f& tf, const fcl::Vec3f& direction, std::vector<fcl::Vec3f>& points)
+{
+    const fcl::Vec3f half(s->side * 0.5);
+    for (int i = 0; i < 8; i++) {
+        points.push_back(tf.transform(fcl::Vec3f((i & 1) ? half[0] : -half[0], (i & 2) ? half[1] : -half[1], (i & 4) ? half[2] : -half[2])));
+    }
+}
+
+/* samples of the rim of radius r at height z, and its point farthest along direction unless the rim faces it */
+void
+RimPoints(fcl::FCL_REAL r, fcl::FCL_REAL z, const fcl::Transform3f& tf, const fcl::Vec3f& direction, std::vector<fcl::Vec3f>& points)
+{
+    const int iNumSamples(8);
+    for (int i = 0; i < iNumSamples; i++) {
+        const fcl::FCL_REAL a(2. * M_PI * i / iNumSamples);
+        points.push_back(tf.transform(fcl::Vec3f(r * std::cos(a), r * std::sin(a), z)));
+    }
+    const fcl::Vec3f d(tf.getRotation().transposeDot(direction));
+    const fcl::FCL_REAL rho(std::sqrt(d[0] * d[0] + d[1] * d[1]));
+    if (rho > 1.e-6 * d.length()) {
+        points.push_back(tf.transform(fcl::Vec3f(r * d[0] / rho, r * d[1] / rho, z)));
+    }
+}
+
+void
+PatchPoints(const fcl::Cylinder* s, const fcl::Transform3f& tf, const fcl::Vec3f& direction, std::vector<fcl::Vec3f>& points)
+{
+    RimPoints(s->radius, -0.5 * s->lz, tf, direction, points);
+    RimPoints(s->radius, 0.5 * s->lz, tf, direction, points);
+}
+
+void
+PatchPoints(const fcl::Cone* s, const fcl::Transform3f& tf, const fcl::Vec3f& direction, std::vector<fcl::Vec3f>& points)
+{
+    points.push_back(tf.transform(fcl::Vec3f(0., 0., 0.5 * s->lz)));
+    RimPoints(s->radius, -0.5 * s->lz, tf, direction, points);
+}
+
+/*
+ * Distance from p, inside the shape, to its surface along the unit direction u;
+ * false if p lies outside.  Only boxes and planes, whose patches it measures
+ * exactly, take part; planes bound the half space behind their normal.
+ */
+template<typename T_SH>
+bool
+ExitDepth(const T_SH* s, const fcl::Transform3f& tf, const fcl::Vec3f& p, const fcl::Vec3f& u, fcl::FCL_REAL& t)
+{
+    return false;
+}
+
+bool
+ExitDepth(const fcl::Box* s, const fcl::Transform3f& tf, const fcl::Vec3f& p, const fcl::Vec3f& u, fcl::FCL_REAL& t)
+{
+    const fcl::Matrix3f& R(tf.getRotation());
+    const fcl::Vec3f q(R.transposeDot(p - tf.getTranslation()));
+    const fcl::Vec3f v(R.transposeDot(u));
+    t = std::numeric_limits<fcl::FCL_REAL>::max();
+    for (int i = 0; i < 3; i++) {
+        const fcl::FCL_REAL h(0.5 * s->side[i]);
+        if (std::abs(q[i]) > h) {
+            return false;
+        }
+        if (v[i] > 0.) {
+            t = std::min(t, (h - q[i]) / v[i]);
+        } else if (v[i] < 0.) {
+            t = std::min(t, (-h - q[i]) / v[i]);
+        }
+    }
+    return true;
+}
+
+bool
+ExitDepth(const fcl::Plane* s, const fcl::Transform3f& tf, const fcl::Vec3f& p, const fcl::Vec3f& u, fcl::FCL_REAL& t)
+{
+    const fcl::Plane plane(fcl::transform(*s, tf));
+    const fcl::FCL_REAL signed_dist(plane.signedDistance(p));
+    const fcl::FCL_REAL c(plane.n.dot(u));
+    if (signed_dist > 0. || !(c > 0.)) {
+        return false;
+    }
+    t = -signed_dist / c;
+    return true;
+}
+
+/*
+ * Convex pairs without an analytic kernel go through FCL's GJK/EPA, seeded
+ * with the search direction the pair ended with last time.  The iteration
+ * limits stay FCL's own, since a GJK cut short reports no intersection and
+ * the contact would be lost.  FCL solves box-box, sphere-box and any shape
+ * against a plane in closed form, and those ignore the seed; what the seed
+ * saves elsewhere is measured by benchmarks/narrowphase.cc.
+ *
+ * EPA yields one point, which jumps across a face resting on another and
+ * cannot resist rotation about it.  When the other shape is a box or a plane,
+ * the corners, apexes and rim points of a shape that lie inside it make a
+ * patch, each point as deep as the other surface is along the EPA normal
+ * there; ReduceContacts keeps the spread-out ones.  Without any, as for edges
+ * crossing or rims inside cylinders and cones, the EPA point is used.  Points
+ * are shifted by the margin like the others.
+ */
+template<typename T_SH1, typename T_SH2>
+void
+ConvexFunc(fcl::CollisionObject* pObject1, fcl::CollisionObject* pObject2, fcl::FCL_REAL margin,
+    NarrowphaseCache& cache, Vec3f_pairs& Rf_pairs)
+{
+    const T_SH1* s1 = static_cast<const T_SH1*>(pObject1->collisionGeometry().get());
+    const T_SH2* s2 = static_cast<const T_SH2*>(pObject2->collisionGeometry().get());
+    const fcl::Transform3f& tf1(pObject1->getTransform());
+    const fcl::Transform3f& tf2(pObject2->getTransform());
+    fcl::GJKSolver_indep solver;
+    solver.enableCachedGuess(cache.bValid);
+    if (cache.bValid) {
+        solver.setCachedGuess(cache.guess);
+    }
+    fcl::Vec3f point;
+    fcl::Vec3f normal;
+    fcl::FCL_REAL depth;
+    const bool bIntersect(solver.shapeIntersect(*s1, tf1, *s2, tf2, &point, &depth, &normal));
+    cache.guess = solver.getCachedGuess();
+    cache.bValid = true;
+    if (!bIntersect) {
+        return;
+    }
+    /* FCL versions disagree on the sign of the normal, make it point from 1 to 2 */
+    if (normal.dot(Towards(pObject1, s2, pObject2)) < 0.) {
+        normal = -normal;
+    }
+    const fcl::Vec3f pt1(point + normal * (0.5 * depth));
+    const fcl::Vec3f pt2(point - normal * (0.5 * depth));
+
+    const std::size_t iFirst(Rf_pairs.size());
+    std::vector<fcl::Vec3f> points;
+    PatchPoints(s1, tf1, normal, points);
+    for (std::vector<fcl::Vec3f>::const_iterator p = points.begin(); p != points.end(); p++) {
+        fcl::FCL_REAL d;
+        if (ExitDepth(s2, tf2, *p, -normal, d) && d > 0.) {
+            Rf_pairs.push_back(std::make_pair(*p + normal * margin, *p - normal * d));
+        }
+    }
+    points.clear();
+    PatchPoints(s2, tf2, -normal, points);
+    for (std::vector<fcl::Vec3f>::const_iterator p = points.begin(); p != points.end(); p++) {
+        fcl::FCL_REAL d;
+        if (ExitDepth(s1, tf1, *p, normal, d) && d > 0.) {
+            Rf_pairs.push_back(std::make_pair(*p + normal * (d + margin), *p));
+        }
+    }
+    if (Rf_pairs.size() == iFirst) {
+        Rf_pairs.push_back(std::make_pair(pt1 + normal * margin, pt2));
+    }
+}
+
+/*
+ * The bounds of pObject2, brought into the compound frame and inflated by the
+ * margin, select the children to test; each child is placed in the world and
+ * handed to the kernel of its own shape, swapping the pairs back when only the
+ * reverse kernel exists.  A compound against a compound descends into both.
+ */
+void
+CompoundFunc(fcl::CollisionObject* pObject1, fcl::CollisionObject* pObject2, fcl::FCL_REAL margin,
+    NarrowphaseCache& cache, Vec3f_pairs& Rf_pairs)
+{
+    static const FuncMatrix func_matrix;
+    const Compound* s1 = static_cast<const Compound*>(pObject1->collisionGeometry().get());
+    const fcl::Transform3f& tf1(pObject1->getTransform());
+    const fcl::Matrix3f& R1(tf1.getRotation());
+    const fcl::AABB& box2(pObject2->getAABB());
+    const fcl::Vec3f center(R1.transposeDot(box2.center() - tf1.getTranslation()));
+    const fcl::Vec3f half((box2.max_ - box2.min_) * 0.5);
+    fcl::Vec3f extent;
+    for (int i = 0; i < 3; i++) {
+        extent[i] = std::abs(R1(0, i)) * half[0] + std::abs(R1(1, i)) * half[1] + std::abs(R1(2, i)) * half[2] + margin;
+    }
+    std::vector<uint32_t> children;
+    s1->Query(fcl::AABB(center - extent, center + extent), children);
+    Vec3f_pairs child_pairs;
+    for (std::vector<uint32_t>::const_iterator it = children.begin(); it != children.end(); it++) {
+        /* children change from call to call, their kernels start cold */
+        NarrowphaseCache child_cache;
+        fcl::CollisionObject* pChild(s1->GetChild(*it, tf1));
+        Func func(func_matrix.GetFunc(std::make_pair(pChild, pObject2)));
+        if (func) {
+            func(pChild, pObject2, margin, child_cache, Rf_pairs);
+            continue;
+        }
+        func = func_matrix.GetFunc(std::make_pair(pObject2, pChild));
+        if (func) {
+            child_pairs.clear();
+            func(pObject2, pChild, margin, child_cache, child_pairs);
+            for (Vec3f_pairs::const_iterator pt = child_pairs.begin(); pt != child_pairs.end(); pt++) {
+                Rf_pairs.push_back(std::make_pair(pt->second, pt->first));
+            }
+        }
+    }
 }
 
 FuncMatrix::FuncMatrix(void)
 {
-    for(int i = 0; i < fcl::NODE_COUNT; i++) {
-        for(int j = 0; j < fcl::NODE_COUNT; j++) {
+    for(int i = 0; i < NODE_COUNT; i++) {
+        for(int j = 0; j < NODE_COUNT; j++) {
             funcs[i][j] = NULL;
         }
     }
     funcs[fcl::GEOM_SPHERE][fcl::GEOM_SPHERE] = &GenFunc<fcl::Sphere, fcl::Sphere>;;
     funcs[fcl::GEOM_SPHERE][fcl::GEOM_PLANE] = &GenFunc<fcl::Sphere, fcl::Plane>;;
+    funcs[fcl::GEOM_SPHERE][fcl::GEOM_CAPSULE] = &GenFunc<fcl::Sphere, fcl::Capsule>;
+    funcs[fcl::GEOM_CAPSULE][fcl::GEOM_PLANE] = &GenFunc<fcl::Capsule, fcl::Plane>;
+    funcs[fcl::GEOM_SPHERE][GEOM_HEIGHTFIELD] = &GenFunc<fcl::Sphere, Heightfield>;
+    funcs[fcl::GEOM_CAPSULE][GEOM_HEIGHTFIELD] = &GenFunc<fcl::Capsule, Heightfield>;
+    funcs[fcl::GEOM_SPHERE][GEOM_MESH] = &GenFunc<fcl::Sphere, Mesh>;
+    funcs[fcl::GEOM_CAPSULE][GEOM_MESH] = &GenFunc<fcl::Capsule, Mesh>;
+    funcs[fcl::GEOM_SPHERE][GEOM_SDF] = &GenFunc<fcl::Sphere, DistanceField>;
+    funcs[fcl::GEOM_CAPSULE][GEOM_SDF] = &GenFunc<fcl::Capsule, DistanceField>;
+    funcs[fcl::GEOM_SPHERE][fcl::GEOM_BOX] = &ConvexFunc<fcl::Sphere, fcl::Box>;
+    funcs[fcl::GEOM_SPHERE][fcl::GEOM_CONE] = &ConvexFunc<fcl::Sphere, fcl::Cone>;
+    funcs[fcl::GEOM_SPHERE][fcl::GEOM_CYLINDER] = &ConvexFunc<fcl::Sphere, fcl::Cylinder>;
+    funcs[fcl::GEOM_CAPSULE][fcl::GEOM_CAPSULE] = &ConvexFunc<fcl::Capsule, fcl::Capsule>;
+    funcs[fcl::GEOM_CAPSULE][fcl::GEOM_BOX] = &ConvexFunc<fcl::Capsule, fcl::Box>;
+    funcs[fcl::GEOM_CAPSULE][fcl::GEOM_CONE] = &ConvexFunc<fcl::Capsule, fcl::Cone>;
+    funcs[fcl::GEOM_CAPSULE][fcl::GEOM_CYLINDER] = &ConvexFunc<fcl::Capsule, fcl::Cylinder>;
+    funcs[fcl::GEOM_BOX][fcl::GEOM_BOX] = &ConvexFunc<fcl::Box, fcl::Box>;
+    funcs[fcl::GEOM_BOX][fcl::GEOM_CONE] = &ConvexFunc<fcl::Box, fcl::Cone>;
+    funcs[fcl::GEOM_BOX][fcl::GEOM_CYLINDER] = &ConvexFunc<fcl::Box, fcl::Cylinder>;
+    funcs[fcl::GEOM_BOX][fcl::GEOM_PLANE] = &ConvexFunc<fcl::Box, fcl::Plane>;
+    funcs[fcl::GEOM_CONE][fcl::GEOM_CONE] = &ConvexFunc<fcl::Cone, fcl::Cone>;
+    funcs[fcl::GEOM_CONE][fcl::GEOM_CYLINDER] = &ConvexFunc<fcl::Cone, fcl::Cylinder>;
+    funcs[fcl::GEOM_CONE][fcl::GEOM_PLANE] = &ConvexFunc<fcl::Cone, fcl::Plane>;
+    funcs[fcl::GEOM_CYLINDER][fcl::GEOM_CYLINDER] = &ConvexFunc<fcl::Cylinder, fcl::Cylinder>;
+    funcs[fcl::GEOM_CYLINDER][fcl::GEOM_PLANE] = &ConvexFunc<fcl::Cylinder, fcl::Plane>;
+    for(int j = 0; j < NODE_COUNT; j++) {
+        funcs[GEOM_COMPOUND][j] = &CompoundFunc;
+    }
 }
 
 Func
-FuncMatrix::GetFunc(ObjectPair object_pair) {
+FuncMatrix::GetFunc(ObjectPair object_pair) const {
     return funcs[object_pair.first->getNodeType()][object_pair.second->getNodeType()];
 }  
 
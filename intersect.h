@@ -1,3 +1,6 @@
+#ifndef INTERSECT_H
+#define INTERSECT_H
+
 #include <boost/foreach.hpp>
 #include <fcl/shape/geometric_shapes.h>
 #include <fcl/shape/geometric_shapes_utility.h>
@@ -5,21 +8,53 @@
 #include <fcl/broadphase/broadphase.h>
 #include <fcl/collision.h>
 
+namespace FCL
+{
+
+/* shapes implemented by the module are numbered after FCL's own node types */
+enum NODE_TYPE {
+    GEOM_HEIGHTFIELD = fcl::NODE_COUNT,
+    GEOM_MESH,
+    GEOM_SDF,
+    GEOM_COMPOUND,
+    NODE_COUNT
+};
+
+} // FCL
+
+#include "heightfield.h"
+#include "mesh.h"
+#include "sdf.h"
+#include "compound.h"
+
 namespace FCL
 {
 typedef boost::shared_ptr <const fcl::CollisionGeometry> constCollisionGeometryPtr_t;
 typedef boost::shared_ptr <fcl::CollisionGeometry> CollisionGeometryPtr_t;
 typedef std::pair<fcl::CollisionObject*, fcl::CollisionObject*> ObjectPair;
 typedef std::vector<std::pair<fcl::Vec3f, fcl::Vec3f> > Vec3f_pairs;
-typedef void (*Func)(fcl::CollisionObject* pObject1, fcl::CollisionObject* pObject2, Vec3f_pairs& Rf_pairs);
+/* what a pair keeps from one call to the next to seed the GJK/EPA kernels */
+class NarrowphaseCache {
+public:
+    NarrowphaseCache(void) : guess(1., 0., 0.), bValid(false) {};
+    fcl::Vec3f guess;
+    bool bValid;
+};
+/* margin inflates the first shape, so pairs within the margin are reported too */
+typedef void (*Func)(fcl::CollisionObject* pObject1, fcl::CollisionObject* pObject2, fcl::FCL_REAL margin,
+    NarrowphaseCache& cache, Vec3f_pairs& Rf_pairs);
+
+/* keeps at most max_pairs pairs: the deepest, then those spreading farthest from the ones kept */
+void ReduceContacts(Vec3f_pairs& Rf_pairs, std::size_t max_pairs);
 
 class FuncMatrix {
 private:
-    Func funcs[fcl::NODE_COUNT][fcl::NODE_COUNT];
+    Func funcs[NODE_COUNT][NODE_COUNT];
 public:
     FuncMatrix(void);
-    Func GetFunc(ObjectPair object_pair);
+    Func GetFunc(ObjectPair object_pair) const;
 };
 
 } // FCL
 
+#endif
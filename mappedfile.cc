@@ -0,0 +1,42 @@
+#include "mbconfig.h"           /* This goes first in every *.c,*.cc file */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mappedfile.h"
+
+namespace FCL
+{
+
+MappedFile::MappedFile(const std::string& file_name)
+: p(MAP_FAILED),
+size(0)
+{
+    const int fd(open(file_name.c_str(), O_RDONLY));
+    if (fd == -1) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        size = st.st_size;
+        p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile(void)
+{
+    if (p != MAP_FAILED) {
+        munmap(p, size);
+    }
+}
+
+void
+MappedFile::Release(void)
+{
+    p = MAP_FAILED;
+}
+
+} // FCL
@@ -0,0 +1,27 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+
+namespace FCL
+{
+
+/*
+ * A whole file mapped read only, unmapped on destruction unless Release()
+ * hands the mapping over to its new owner.  p is MAP_FAILED if the file
+ * could not be opened or mapped, or is empty.
+ */
+struct MappedFile {
+    void* p;
+    std::size_t size;
+    MappedFile(const std::string& file_name);
+    ~MappedFile(void);
+    void Release(void);
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+} // FCL
+
+#endif
@@ -0,0 +1,404 @@
+#include "mbconfig.h"           /* This goes first in every *.c,*.cc file */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <stdexcept>
+#include <sys/mman.h>
+
+#include "intersect.h"
+#include "mappedfile.h"
+
+namespace FCL
+{
+
+namespace
+{
+const uint32_t cache_version(1);
+const std::size_t cache_header_size(64);
+const uint32_t leaf_size(4);
+const uint32_t query_stack_size(64);
+
+uint64_t
+Hash(const char* p, std::size_t size)
+{
+    /* FNV-1a */
+    uint64_t h(14695981039346656037ULL);
+    for (std::size_t i = 0; i < size; i++) {
+        h ^= uint64_t(static_cast<unsigned char>(p[i]));
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+struct CompareCentroids {
+    const std::vector<fcl::Vec3f>& centroids;
+    const int axis;
+    CompareCentroids(const std::vector<fcl::Vec3f>& centroids, int axis) : centroids(centroids), axis(axis) {};
+    bool operator()(uint32_t i, uint32_t j) const { return centroids[i][axis] < centroids[j][axis]; };
+};
+
+std::size_t
+TrisOffset(uint32_t nv)
+{
+    return cache_header_size + std::size_t(nv) * 3 * sizeof(double);
+}
+
+std::size_t
+NodesOffset(uint32_t nv, uint32_t nt)
+{
+    const std::size_t offset(TrisOffset(nv) + std::size_t(nt) * 3 * sizeof(uint32_t));
+    return (offset + 7) & ~std::size_t(7);
+}
+}
+
+Mesh::Mesh(const std::string& file_name)
+: pMap(MAP_FAILED),
+map_size(0),
+pVertices(NULL),
+pTris(NULL),
+pNodes(NULL),
+num_vertices(0),
+num_tris(0),
+num_nodes(0)
+{
+    MappedFile mesh_file(file_name);
+    if (mesh_file.p == MAP_FAILED) {
+        throw std::runtime_error("unable to map mesh file \"" + file_name + "\"");
+    }
+    const char* p(static_cast<const char*>(mesh_file.p));
+    const uint64_t hash(Hash(p, mesh_file.size));
+    const std::string cache_name(file_name + ".bvh");
+    if (!LoadCache(cache_name, hash)) {
+        std::string extension(file_name.substr(file_name.find_last_of('.') + 1));
+        for (std::string::iterator it = extension.begin(); it != extension.end(); it++) {
+            *it = std::tolower(*it);
+        }
+        if (extension == "obj") {
+            ReadOBJ(p, mesh_file.size, file_name);
+        } else {
+            ReadSTL(p, mesh_file.size, file_name);
+        }
+        if (tris.empty()) {
+            throw std::runtime_error("mesh file \"" + file_name + "\" has no triangles");
+        }
+        Build();
+        SaveCache(cache_name, hash);
+    }
+    computeLocalAABB();
+}
+
+Mesh::~Mesh(void)
+{
+    if (pMap != MAP_FAILED) {
+        munmap(pMap, map_size);
+    }
+}
+
+bool
+Mesh::LoadCache(const std::string& cache_name, uint64_t hash)
+{
+    MappedFile cache_file(cache_name);
+    if (cache_file.p == MAP_FAILED || cache_file.size < cache_header_size) {
+        return false;
+    }
+    const char* p(static_cast<const char*>(cache_file.p));
+    uint32_t version;
+    uint64_t cached_hash;
+    uint32_t n[3];
+    std::memcpy(&version, p + 4, sizeof(version));
+    std::memcpy(&cached_hash, p + 8, sizeof(cached_hash));
+    std::memcpy(n, p + 16, sizeof(n));
+    if (std::memcmp(p, "MBVH", 4) != 0 || version != cache_version || cached_hash != hash
+        || n[1] == 0 || n[2] == 0
+        || cache_file.size != NodesOffset(n[0], n[1]) + std::size_t(n[2]) * sizeof(Node)) {
+        return false;
+    }
+    num_vertices = n[0];
+    num_tris = n[1];
+    num_nodes = n[2];
+    pVertices = reinterpret_cast<const double*>(p + cache_header_size);
+    pTris = reinterpret_cast<const uint32_t*>(p + TrisOffset(num_vertices));
+    pNodes = reinterpret_cast<const Node*>(p + NodesOffset(num_vertices, num_tris));
+    if (!IsCacheValid()) {
+        pVertices = NULL;
+        pTris = NULL;
+        pNodes = NULL;
+        num_vertices = 0;
+        num_tris = 0;
+        num_nodes = 0;
+        return false;
+    }
+    pMap = cache_file.p;
+    map_size = cache_file.size;
+    cache_file.Release();
+    return true;
+}
+
+bool
+Mesh::IsCacheValid(void) const
+{
+    /* a stale or damaged cache must not send Query() or Triangle() out of the mapping */
+    for (std::size_t i = 0; i < std::size_t(num_tris) * 3; i++) {
+        if (pTris[i] >= num_vertices) {
+            return false;
+        }
+    }
+    /* children follow their parent, so there are no cycles and the deepest path to each node is known in one pass */
+    std::vector<uint32_t> depth(num_nodes, 0);
+    for (uint32_t i = 0; i < num_nodes; i++) {
+        const Node& node(pNodes[i]);
+        if (node.count > 0) {
+            if (node.first > num_tris || node.count > num_tris - node.first) {
+                return false;
+            }
+            continue;
+        }
+        if (i + 1 >= num_nodes || node.first <= i + 1 || node.first >= num_nodes) {
+            return false;
+        }
+        depth[i + 1] = std::max(depth[i + 1], depth[i] + 1);
+        depth[node.first] = std::max(depth[node.first], depth[i] + 1);
+        /* Query() keeps at most one pending node per level, plus the one it pops */
+        if (depth[i] + 2 > query_stack_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+Mesh::SaveCache(const std::string& cache_name, uint64_t hash) const
+{
+    /* the cache is an optimization: failing to write it is not an error */
+    const std::string tmp_name(cache_name + ".tmp");
+    FILE* fp(std::fopen(tmp_name.c_str(), "wb"));
+    if (fp == NULL) {
+        return;
+    }
+    char header[cache_header_size];
+    std::memset(header, 0, sizeof(header));
+    const uint32_t n[3] = { num_vertices, num_tris, num_nodes };
+    std::memcpy(header, "MBVH", 4);
+    std::memcpy(header + 4, &cache_version, sizeof(cache_version));
+    std::memcpy(header + 8, &hash, sizeof(hash));
+    std::memcpy(header + 16, n, sizeof(n));
+    const char padding[8] = { 0 };
+    const std::size_t padding_size(NodesOffset(num_vertices, num_tris) - TrisOffset(num_vertices) - std::size_t(num_tris) * 3 * sizeof(uint32_t));
+    bool bOk(std::fwrite(header, sizeof(header), 1, fp) == 1
+        && std::fwrite(pVertices, sizeof(double), std::size_t(num_vertices) * 3, fp) == std::size_t(num_vertices) * 3
+        && std::fwrite(pTris, sizeof(uint32_t), std::size_t(num_tris) * 3, fp) == std::size_t(num_tris) * 3
+        && std::fwrite(padding, 1, padding_size, fp) == padding_size
+        && std::fwrite(pNodes, sizeof(Node), num_nodes, fp) == num_nodes);
+    bOk = (std::fclose(fp) == 0) && bOk;
+    if (!bOk || std::rename(tmp_name.c_str(), cache_name.c_str()) != 0) {
+        std::remove(tmp_name.c_str());
+    }
+}
+
+void
+Mesh::ReadSTL(const char* p, std::size_t size, const std::string& file_name)
+{
+    uint32_t n(0);
+    if (size >= 84) {
+        std::memcpy(&n, p + 80, sizeof(n));
+    }
+    if (size < 84 || size != 84 + std::size_t(n) * 50) {
+        throw std::runtime_error("mesh file \"" + file_name + "\" is not a binary STL file");
+    }
+    vertices.resize(std::size_t(n) * 9);
+    tris.resize(std::size_t(n) * 3);
+    for (uint32_t i = 0; i < n; i++) {
+        /* skip the facet normal, keep the three vertices */
+        float v[9];
+        std::memcpy(v, p + 84 + std::size_t(i) * 50 + 12, sizeof(v));
+        for (int k = 0; k < 9; k++) {
+            vertices[std::size_t(i) * 9 + k] = v[k];
+        }
+        for (int k = 0; k < 3; k++) {
+            tris[std::size_t(i) * 3 + k] = i * 3 + k;
+        }
+    }
+}
+
+void
+Mesh::ReadOBJ(const char* p, std::size_t size, const std::string& file_name)
+{
+    std::string line;
+    std::size_t begin(0);
+    while (begin < size) {
+        const char* eol(static_cast<const char*>(std::memchr(p + begin, '\n', size - begin)));
+        const std::size_t end(eol ? eol - p : size);
+        line.assign(p + begin, end - begin);
+        begin = end + 1;
+        if (line.size() > 2 && line[0] == 'v' && line[1] == ' ') {
+            const char* s(line.c_str() + 2);
+            char* e;
+            for (int k = 0; k < 3; k++) {
+                vertices.push_back(std::strtod(s, &e));
+                if (e == s) {
+                    throw std::runtime_error("mesh file \"" + file_name + "\" has an invalid vertex: " + line);
+                }
+                s = e;
+            }
+        } else if (line.size() > 2 && line[0] == 'f' && line[1] == ' ') {
+            /* polygons are triangulated as fans; texture and normal indices are ignored */
+            std::vector<uint32_t> face;
+            const char* s(line.c_str() + 2);
+            char* e;
+            for (long index = std::strtol(s, &e, 10); e != s; index = std::strtol(s, &e, 10)) {
+                const long nv(vertices.size() / 3);
+                index = (index < 0) ? nv + index : index - 1;
+                if (index < 0 || index >= nv) {
+                    throw std::runtime_error("mesh file \"" + file_name + "\" has an invalid face: " + line);
+                }
+                face.push_back(index);
+                s = e;
+                while (*s != '\0' && !std::isspace(static_cast<unsigned char>(*s))) {
+                    s++;
+                }
+            }
+            for (std::size_t k = 2; k < face.size(); k++) {
+                tris.push_back(face[0]);
+                tris.push_back(face[k - 1]);
+                tris.push_back(face[k]);
+            }
+        }
+    }
+}
+
+void
+Mesh::Build(void)
+{
+    num_vertices = vertices.size() / 3;
+    num_tris = tris.size() / 3;
+    std::vector<uint32_t> order(num_tris);
+    std::vector<fcl::Vec3f> centroids(num_tris);
+    pVertices = &vertices[0];
+    pTris = &tris[0];
+    for (uint32_t i = 0; i < num_tris; i++) {
+        fcl::Vec3f a, b, c;
+        Triangle(i, a, b, c);
+        centroids[i] = (a + b + c) * (1.0 / 3.0);
+        order[i] = i;
+    }
+    nodes.clear();
+    nodes.reserve(2 * (num_tris / leaf_size + 1));
+    Build(order, centroids, 0, num_tris);
+
+    /* store triangles in leaf order so that each leaf is a contiguous range */
+    std::vector<uint32_t> sorted_tris(tris.size());
+    for (uint32_t i = 0; i < num_tris; i++) {
+        std::copy(&tris[std::size_t(order[i]) * 3], &tris[std::size_t(order[i]) * 3] + 3, &sorted_tris[std::size_t(i) * 3]);
+    }
+    tris.swap(sorted_tris);
+    num_nodes = nodes.size();
+    pVertices = &vertices[0];
+    pTris = &tris[0];
+    pNodes = &nodes[0];
+}
+
+uint32_t
+Mesh::Build(std::vector<uint32_t>& order, std::vector<fcl::Vec3f>& centroids, uint32_t begin, uint32_t end)
+{
+    const uint32_t index(nodes.size());
+    nodes.push_back(Node());
+    Node node;
+    fcl::Vec3f cmin(centroids[order[begin]]);
+    fcl::Vec3f cmax(cmin);
+    for (int k = 0; k < 3; k++) {
+        node.min[k] = cmin[k];
+        node.max[k] = cmin[k];
+    }
+    for (uint32_t i = begin; i < end; i++) {
+        for (int v = 0; v < 3; v++) {
+            const double* x(&vertices[std::size_t(tris[std::size_t(order[i]) * 3 + v]) * 3]);
+            for (int k = 0; k < 3; k++) {
+                node.min[k] = std::min(node.min[k], x[k]);
+                node.max[k] = std::max(node.max[k], x[k]);
+            }
+        }
+        cmin = fcl::min(cmin, centroids[order[i]]);
+        cmax = fcl::max(cmax, centroids[order[i]]);
+    }
+    if (end - begin <= leaf_size) {
+        node.first = begin;
+        node.count = end - begin;
+        nodes[index] = node;
+        return index;
+    }
+
+    /* median split along the longest extent of the centroids */
+    const fcl::Vec3f extent(cmax - cmin);
+    int axis(0);
+    if (extent[1] > extent[axis]) {
+        axis = 1;
+    }
+    if (extent[2] > extent[axis]) {
+        axis = 2;
+    }
+    const uint32_t mid(begin + (end - begin) / 2);
+    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, CompareCentroids(centroids, axis));
+    Build(order, centroids, begin, mid);
+    node.first = Build(order, centroids, mid, end);
+    node.count = 0;
+    nodes[index] = node;
+    return index;
+}
+
+void
+Mesh::computeLocalAABB(void)
+{
+    aabb_local = fcl::AABB(fcl::Vec3f(pNodes[0].min[0], pNodes[0].min[1], pNodes[0].min[2]),
+        fcl::Vec3f(pNodes[0].max[0], pNodes[0].max[1], pNodes[0].max[2]));
+    aabb_center = aabb_local.center();
+    aabb_radius = (aabb_local.min_ - aabb_center).length();
+}
+
+fcl::NODE_TYPE
+Mesh::getNodeType(void) const
+{
+    return fcl::NODE_TYPE(GEOM_MESH);
+}
+
+void
+Mesh::Query(const fcl::AABB& box, std::vector<uint32_t>& triangles) const
+{
+    uint32_t stack[query_stack_size];
+    int iStackSize(0);
+    stack[iStackSize++] = 0;
+    while (iStackSize > 0) {
+        const uint32_t index(stack[--iStackSize]);
+        const Node& node(pNodes[index]);
+        if (node.min[0] > box.max_[0] || node.max[0] < box.min_[0]
+            || node.min[1] > box.max_[1] || node.max[1] < box.min_[1]
+            || node.min[2] > box.max_[2] || node.max[2] < box.min_[2]) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                triangles.push_back(i);
+            }
+        } else {
+            /* median splits keep the depth well below the stack size */
+            stack[iStackSize++] = node.first;
+            stack[iStackSize++] = index + 1;
+        }
+    }
+}
+
+void
+Mesh::Triangle(uint32_t i, fcl::Vec3f& a, fcl::Vec3f& b, fcl::Vec3f& c) const
+{
+    const uint32_t* t(pTris + std::size_t(i) * 3);
+    const double* va(pVertices + std::size_t(t[0]) * 3);
+    const double* vb(pVertices + std::size_t(t[1]) * 3);
+    const double* vc(pVertices + std::size_t(t[2]) * 3);
+    a.setValue(va[0], va[1], va[2]);
+    b.setValue(vb[0], vb[1], vb[2]);
+    c.setValue(vc[0], vc[1], vc[2]);
+}
+
+} // FCL
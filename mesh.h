@@ -0,0 +1,63 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <fcl/shape/geometric_shapes.h>
+
+namespace FCL
+{
+
+/*
+ * Triangle mesh with its own bounding volume hierarchy, in the local frame of
+ * the collision object.  Binary STL and Wavefront OBJ files are read through
+ * mmap.  The BVH is built once and written next to the mesh as <file_name>.bvh,
+ * tagged with a hash of the mesh file content; later loads of an unchanged mesh
+ * map the cached vertices, triangles and nodes directly instead of rebuilding.
+ *
+ * Nodes are stored depth first: the left child of an internal node follows it,
+ * first is the index of the right child and count is 0.  A leaf holds count
+ * triangles starting at first.
+ */
+class Mesh : public fcl::ShapeBase {
+public:
+    struct Node {
+        double min[3];
+        double max[3];
+        uint32_t first;
+        uint32_t count;
+    };
+private:
+    void* pMap;
+    std::size_t map_size;
+    std::vector<double> vertices;
+    std::vector<uint32_t> tris;
+    std::vector<Node> nodes;
+    const double* pVertices;
+    const uint32_t* pTris;
+    const Node* pNodes;
+    uint32_t num_vertices;
+    uint32_t num_tris;
+    uint32_t num_nodes;
+    /* false, and the mesh is rebuilt, if the cache is missing, stale or has out of range indices */
+    bool LoadCache(const std::string& cache_name, uint64_t hash);
+    bool IsCacheValid(void) const;
+    void SaveCache(const std::string& cache_name, uint64_t hash) const;
+    void ReadSTL(const char* p, std::size_t size, const std::string& file_name);
+    void ReadOBJ(const char* p, std::size_t size, const std::string& file_name);
+    void Build(void);
+    uint32_t Build(std::vector<uint32_t>& order, std::vector<fcl::Vec3f>& centroids, uint32_t begin, uint32_t end);
+public:
+    Mesh(const std::string& file_name);
+    ~Mesh(void);
+    void computeLocalAABB(void);
+    fcl::NODE_TYPE getNodeType(void) const;
+    /* appends the triangles whose bounds overlap box, in local coordinates */
+    void Query(const fcl::AABB& box, std::vector<uint32_t>& triangles) const;
+    void Triangle(uint32_t i, fcl::Vec3f& a, fcl::Vec3f& b, fcl::Vec3f& c) const;
+};
+
+} // FCL
+
+#endif
@@ -35,36 +35,154 @@
 
 #include <ostream>
 #include <cfloat>
+#include <cstring>
+#include <time.h>
 
 #include "dataman.h"
 #include "userelem.h"
 #include <set>
+#include <algorithm>
 #include "rodj.h"
+#include "constltp_impl.h"
+#include "tpldrive_impl.h"
 #include <limits>
+#include <stdexcept>
 #include "module-collision.h"
+#include "gridbroadphase.h"
 
-Contact::Contact(std::pair<fcl::Vec3f, fcl::Vec3f> pt_pair, const StructDispNode* pNode1, const StructDispNode* pNode2, doublereal penetration_ratio)
-: Ft(Zero3), Fn_Norm(0.0), tangent(Zero3)
+std::size_t
+ContactBuffer::Size(void) const
+{
+    return pair.size();
+}
+
+void
+ContactBuffer::Clear(void)
+{
+    pair.clear();
+    f1.clear();
+    f2.clear();
+    Arm1.clear();
+    tangent.clear();
+    s1.clear();
+    s2.clear();
+    Ft.clear();
+    Fn_Norm.clear();
+    bSlip.clear();
+}
+
+void
+ContactBuffer::Swap(ContactBuffer& other)
+{
+    pair.swap(other.pair);
+    f1.swap(other.f1);
+    f2.swap(other.f2);
+    Arm1.swap(other.Arm1);
+    tangent.swap(other.tangent);
+    s1.swap(other.s1);
+    s2.swap(other.s2);
+    Ft.swap(other.Ft);
+    Fn_Norm.swap(other.Fn_Norm);
+    bSlip.swap(other.bSlip);
+}
+
+std::size_t
+ContactBuffer::iGetMemory(void) const
+{
+    return pair.capacity() * sizeof(unsigned)
+        + (f1.capacity() + f2.capacity() + Arm1.capacity() + tangent.capacity()
+            + s1.capacity() + s2.capacity() + Ft.capacity()) * sizeof(Vec3)
+        + Fn_Norm.capacity() * sizeof(doublereal) + bSlip.capacity();
+}
+
+void
+ContactBuffer::Add(unsigned iPair, const std::pair<fcl::Vec3f, fcl::Vec3f>& pt_pair,
+    const StructDispNode* pNode1, const StructDispNode* pNode2, doublereal penetration_ratio)
 {
     Vec3 pt1(pt_pair.first[0], pt_pair.first[1], pt_pair.first[2]);
     Vec3 pt2(pt_pair.second[0], pt_pair.second[1], pt_pair.second[2]);
     Mat3x3 R1(dynamic_cast<const StructNode *>(pNode1)->GetRCurr());
     Mat3x3 R2(dynamic_cast<const StructNode *>(pNode2)->GetRCurr());
-    f1 = R1.Transpose() * (pt1 - pNode1->GetXCurr());
-    f2 = R2.Transpose() * (pt2 - pNode2->GetXCurr());
-    Arm1 = R1.Transpose() * (pt1 * penetration_ratio + pt2 * (1.0 - penetration_ratio) - pNode1->GetXCurr());
+    const Vec3 pt(pt1 * penetration_ratio + pt2 * (1.0 - penetration_ratio));
+    pair.push_back(iPair);
+    f1.push_back(R1.Transpose() * (pt1 - pNode1->GetXCurr()));
+    f2.push_back(R2.Transpose() * (pt2 - pNode2->GetXCurr()));
+    Arm1.push_back(R1.Transpose() * (pt - pNode1->GetXCurr()));
+    tangent.push_back(Zero3);
+    s1.push_back(Arm1.back());
+    s2.push_back(R2.Transpose() * (pt - pNode2->GetXCurr()));
+    Ft.push_back(Zero3);
+    Fn_Norm.push_back(0.0);
+    bSlip.push_back(false);
+}
+
+void
+ContactBuffer::Append(unsigned iPair, const ContactBuffer& other, std::size_t i)
+{
+    pair.push_back(iPair);
+    f1.push_back(other.f1[i]);
+    f2.push_back(other.f2[i]);
+    Arm1.push_back(other.Arm1[i]);
+    tangent.push_back(other.tangent[i]);
+    s1.push_back(other.s1[i]);
+    s2.push_back(other.s2[i]);
+    Ft.push_back(other.Ft[i]);
+    Fn_Norm.push_back(other.Fn_Norm[i]);
+    bSlip.push_back(other.bSlip[i]);
+}
+
+CollisionNodeData::CollisionNodeData(const StructNode* pNode)
+: pNode(pNode),
+bTerrain(true),
+bSleeping(false),
+bIslandQuiet(false),
+iQuietSteps(0),
+pIsland(this)
+{
+    NO_OP;
 }
 
-Contact::~Contact(void)
+CollisionNodeData::~CollisionNodeData(void)
 {
     NO_OP;
 }
 
+CollisionNodeData*
+CollisionNodeData::Find(void)
+{
+    /* union-find with path halving */
+    CollisionNodeData* p(this);
+    while (p->pIsland != p) {
+        p->pIsland = p->pIsland->pIsland;
+        p = p->pIsland;
+    }
+    return p;
+}
+
+void
+CollisionNodeData::Union(CollisionNodeData* pOther)
+{
+    CollisionNodeData* p1(Find());
+    CollisionNodeData* p2(pOther->Find());
+    if (p1 != p2) {
+        p2->pIsland = p1;
+    }
+}
+
 CollisionObjectData::CollisionObjectData(const StructNode* pNode,
-    fcl::CollisionObject* pObject, std::string material)
+    fcl::CollisionObject* pObject, std::string material,
+    const Vec3& f, const Mat3x3& R, bool bTerrain, doublereal margin,
+    const DriveCaller* pActivation)
 : pNode(pNode),
 pObject(pObject),
-material(material)
+material(material),
+f(f),
+R(R),
+bTerrain(bTerrain),
+margin(margin),
+pActivation(pActivation),
+bActive(false),
+pNodeData(NULL)
 {
     NO_OP;
 }
@@ -74,132 +192,366 @@ CollisionObjectData::~CollisionObjectData(void)
     NO_OP;
 }
 
-std::map<const unsigned, CollisionObjectData*> collision_object_data;
+void
+CollisionObjectData::UpdateTransform(void)
+{
+    if (pObject->getNodeType() != fcl::GEOM_PLANE) {
+        Vec3 x(pNode->GetXCurr() + pNode->GetRCurr() * f);
+        Mat3x3 r(pNode->GetRCurr() * R);
+        pObject->setTransform(
+            fcl::Matrix3f(r.dGet(1,1),r.dGet(1,2),r.dGet(1,3),r.dGet(2,1),r.dGet(2,2),r.dGet(2,3),r.dGet(3,1),r.dGet(3,2),r.dGet(3,3)),
+            fcl::Vec3f(x[0], x[1], x[2]));
+        pObject->computeAABB();
+    }
+}
+
+std::map<const unsigned, std::vector<CollisionObjectData*> > collision_object_data;
 
-Collision::Collision(FCL::Func func,
-    const ConstitutiveLaw1D* pCL, const BasicScalarFunction* pSF, doublereal penetration_ratio,
-    const CollisionObjectData* pD1, const CollisionObjectData* pD2, integer* piRow, integer* piCol)
-: func(func),
-ConstitutiveLaw1DOwner(pCL),
-pSF(pSF),
-penetration_ratio(penetration_ratio),
-pNode1(pD1->pNode),
+static void
+InflateAABB(const fcl::CollisionGeometry* pGeometry, doublereal margin)
+{
+    /* the broadphase then pairs objects that are within the margin */
+    fcl::CollisionGeometry* pG(const_cast<fcl::CollisionGeometry*>(pGeometry));
+    const fcl::Vec3f delta(margin, margin, margin);
+    pG->aabb_local.min_ -= delta;
+    pG->aabb_local.max_ += delta;
+    pG->aabb_radius += margin;
+}
+
+/* monotonic wall clock, in seconds */
+static doublereal
+dGetWallTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1.e-9 * ts.tv_nsec;
+}
+
+Collision::Collision(FCL::Func func, CollisionMaterial* pMaterial, bool bSwapped,
+    const CollisionObjectData* pD1, const CollisionObjectData* pD2, ContactBuffer* pBuffer)
+: pNode1(pD1->pNode),
 pNode2(pD2->pNode),
 pObject1(pD1->pObject),
 pObject2(pD2->pObject),
-iNumRowsNode(6),
-iNumColsNode(6)
+func(func),
+pMaterial(pMaterial),
+dMargin(pD1->margin + pD2->margin),
+iR1(0),
+iC1(0),
+iR2(0),
+iC2(0),
+pBuffer(pBuffer),
+iFirst(0),
+iNumContacts(0),
+pNodeData1(pD1->pNodeData),
+pNodeData2(pD2->pNodeData),
+iNumClosed(0),
+iLastNumContacts(0),
+bSwapped(bSwapped),
+bSleeping(false)
+{
+    NO_OP;
+}
+
+std::size_t
+Collision::iGetMemory(void) const
 {
-    iR = *piRow;
-    iC = *piCol;
-    *piRow += (2 * iNumRowsNode);
-    *piCol += (2 * iNumColsNode);
+    return sizeof(Collision) + found.capacity() * sizeof(std::pair<fcl::Vec3f, fcl::Vec3f>)
+        + history.capacity() * sizeof(ContactHistory);
 }
 
 void
 Collision::ClearContacts(void)
 {
-    contacts.clear();
+    found.clear();
+    iNumContacts = 0;
+}
+
+bool
+Collision::HasContacts(void) const
+{
+    return iNumContacts > 0;
+}
+
+bool
+Collision::IsSleeping(void) const
+{
+    return bSleeping;
+}
+
+void
+Collision::SetSleeping(bool bSleep)
+{
+    bSleeping = bSleep;
+}
+
+fcl::CollisionObject*
+Collision::pGetObject1(void) const
+{
+    return pObject1;
+}
+
+fcl::CollisionObject*
+Collision::pGetObject2(void) const
+{
+    return pObject2;
+}
+
+bool
+Collision::IsThreadSafe(void) const
+{
+    /* the children of a compound are placed in objects shared by all its pairs */
+    const int iNodeType1(pObject1->getNodeType());
+    const int iNodeType2(pObject2->getNodeType());
+    return iNodeType1 != FCL::GEOM_COMPOUND && iNodeType2 != FCL::GEOM_COMPOUND;
+}
+
+CollisionNodeData*
+Collision::pGetNodeData1(void) const
+{
+    return pNodeData1;
+}
+
+CollisionNodeData*
+Collision::pGetNodeData2(void) const
+{
+    return pNodeData2;
 }
 
 void
 Collision::Intersect(void)
 {
-    FCL::Vec3f_pairs pt_pairs;
-    func(pObject1, pObject2, pt_pairs);
-    for (std::vector<std::pair<fcl::Vec3f, fcl::Vec3f> >::iterator it = pt_pairs.begin();
-        it != pt_pairs.end(); it++) {
-        contacts.push_back(Contact(*it, pNode1, pNode2, penetration_ratio));
-        /* For testing 
-        Vec3 pt1(it->first[0], it->first[1], it->first[2]);
-        Vec3 pt2(it->second[0], it->second[1], it->second[2]);
-        Mat3x3 R1(dynamic_cast<const StructNode *>(pNode1)->GetRCurr());
-        Mat3x3 R2(dynamic_cast<const StructNode *>(pNode2)->GetRCurr());
-        Vec3 f1 = R1.Transpose() * (pt1 - pNode1->GetXCurr());
-        Vec3 f2 = R2.Transpose() * (pt2 - pNode2->GetXCurr());
-        printf("(%f %f %f), (%f %f %f)\n", it->first[0], it->first[1], it->first[2], it->second[0], it->second[1], it->second[2]);
-        printf("(%f %f %f), (%f %f %f)\n", f1(1), f1(2), f1(3), f2(1), f2(2), f2(3));
-        */
+    /* only writes found, so pairs can run concurrently; Gather makes the contacts */
+    found.clear();
+    func(pObject1, pObject2, dMargin, cache, found);
+    FCL::ReduceContacts(found, pMaterial->iMaxContacts);
+}
+
+const FCL::Vec3f_pairs&
+Collision::GetFound(void) const
+{
+    return found;
+}
+
+void
+Collision::SetFound(const fcl::FCL_REAL* points, std::size_t n)
+{
+    found.resize(n);
+    for (std::size_t i = 0; i < n; i++) {
+        const fcl::FCL_REAL* p(points + 6 * i);
+        found[i].first = fcl::Vec3f(p[0], p[1], p[2]);
+        found[i].second = fcl::Vec3f(p[3], p[4], p[5]);
+    }
+}
+
+void
+Collision::Gather(ContactBuffer& to, unsigned iPair, bool bKeep)
+{
+    const std::size_t iNewFirst(to.Size());
+    if (bKeep) {
+        for (std::size_t i = iFirst; i < iFirst + iNumContacts; i++) {
+            to.Append(iPair, *pBuffer, i);
+        }
+    } else {
+        const doublereal penetration_ratio(bSwapped ? 1.0 - pMaterial->penetration_ratio : pMaterial->penetration_ratio);
+        for (FCL::Vec3f_pairs::const_iterator it = found.begin(); it != found.end(); it++) {
+            to.Add(iPair, *it, pNode1, pNode2, penetration_ratio);
+        }
+        MatchHistory(to, iNewFirst);
+    }
+    iFirst = iNewFirst;
+    iNumContacts = to.Size() - iNewFirst;
+}
+
+void
+Collision::MatchHistory(ContactBuffer& to, std::size_t iNewFirst) const
+{
+    /*
+     * Each new contact takes the anchors of the committed contact nearest to it
+     * on body 1, closest pairs first, if within half the spacing of the committed
+     * contacts and the size of the object; the others start sticking afresh.
+     */
+    if (history.empty()) {
+        return;
+    }
+    doublereal dTol(pObject1->collisionGeometry()->aabb_radius);
+    for (std::size_t j = 0; j < history.size(); j++) {
+        for (std::size_t k = j + 1; k < history.size(); k++) {
+            dTol = std::min(dTol, 0.5 * (history[j].f1 - history[k].f1).Norm());
+        }
+    }
+    std::vector<std::pair<doublereal, std::pair<std::size_t, std::size_t> > > candidates;
+    for (std::size_t i = iNewFirst; i < to.Size(); i++) {
+        for (std::size_t j = 0; j < history.size(); j++) {
+            const doublereal d((to.f1[i] - history[j].f1).Norm());
+            if (d <= dTol) {
+                candidates.push_back(std::make_pair(d, std::make_pair(i, j)));
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    std::vector<bool> bNewMatched(to.Size() - iNewFirst, false);
+    std::vector<bool> bOldMatched(history.size(), false);
+    for (std::size_t k = 0; k < candidates.size(); k++) {
+        const std::size_t i(candidates[k].second.first);
+        const std::size_t j(candidates[k].second.second);
+        if (bNewMatched[i - iNewFirst] || bOldMatched[j]) {
+            continue;
+        }
+        bNewMatched[i - iNewFirst] = true;
+        bOldMatched[j] = true;
+        to.tangent[i] = history[j].tangent;
+        to.s1[i] = history[j].s1;
+        to.s2[i] = history[j].s2;
+    }
+}
+
+void
+Collision::CommitStick(void)
+{
+    /* anchors enter the history at the next ClearAndSetTangents */
+    const doublereal dStickStiffness(pMaterial->dStickStiffness);
+    if (dStickStiffness <= 0.) {
+        return;
     }
-    if (tangents.size() == contacts.size()) {
-        for (int i = 0; i < tangents.size(); i++) {
-            contacts[i].tangent = tangents[i];
+    const StructNode* pStructNode1(dynamic_cast<const StructNode *>(pNode1));
+    const StructNode* pStructNode2(dynamic_cast<const StructNode *>(pNode2));
+    const Mat3x3 R1(pStructNode1->GetRCurr());
+    const Mat3x3 R2(pStructNode2->GetRCurr());
+    ContactBuffer& c(*pBuffer);
+    for (std::size_t i = iFirst; i < iFirst + iNumContacts; i++) {
+        if (c.bSlip[i]) {
+            /* slide the anchor on node 2 so that the spring sits at the Coulomb limit */
+            Vec3 normal = pNode2->GetXCurr() + R2 * c.f2[i] - pNode1->GetXCurr() - R1 * c.f1[i];
+            const doublereal depth = normal.Norm();
+            if (std::numeric_limits<doublereal>::epsilon() < depth) {
+                normal /= depth;
+                const Vec3 Rs1(R1 * c.s1[i]);
+                Vec3 d(pNode2->GetXCurr() + R2 * c.s2[i] - pNode1->GetXCurr() - Rs1);
+                d = normal * d.Dot(normal) + c.Ft[i] / dStickStiffness;
+                c.s2[i] = R2.Transpose() * (pNode1->GetXCurr() + Rs1 + d - pNode2->GetXCurr());
+            }
+            c.bSlip[i] = false;
+        }
+    }
+}
+
+bool
+Collision::UpdateContactState(doublereal& dMaxDepth, doublereal& dMaxApproach)
+{
+    /* deepest penetration and fastest closing normal velocity; true if a contact appeared */
+    const StructNode* pStructNode1(dynamic_cast<const StructNode *>(pNode1));
+    const StructNode* pStructNode2(dynamic_cast<const StructNode *>(pNode2));
+    const Mat3x3 R1(pStructNode1->GetRCurr());
+    const Mat3x3 R2(pStructNode2->GetRCurr());
+    const ContactBuffer& c(*pBuffer);
+    for (std::size_t i = iFirst; i < iFirst + iNumContacts; i++) {
+        const Vec3 Rf1(R1 * c.f1[i]);
+        const Vec3 Rf2(R2 * c.f2[i]);
+        Vec3 normal = pNode2->GetXCurr() + Rf2 - pNode1->GetXCurr() - Rf1;
+        const doublereal depth = normal.Norm();
+        dMaxDepth = std::max(dMaxDepth, depth - dMargin);
+        if (std::numeric_limits<doublereal>::epsilon() < depth) {
+            normal /= depth;
+            const Vec3 V(pNode2->GetVCurr() + (pStructNode2->GetWCurr()).Cross(Rf2) - pNode1->GetVCurr() - (pStructNode1->GetWCurr()).Cross(Rf1));
+            dMaxApproach = std::max(dMaxApproach, V.Dot(normal));
         }
     }
+    const bool bNew(iNumContacts > iLastNumContacts);
+    iLastNumContacts = iNumContacts;
+    return bNew;
 }
 
 void
 Collision::ClearAndSetTangents()
 {
-    tangents.clear();
+    history.resize(iNumContacts);
     const StructNode* pStructNode1(dynamic_cast<const StructNode *>(pNode1));
     const StructNode* pStructNode2(dynamic_cast<const StructNode *>(pNode2));
     const Mat3x3 R1(pStructNode1->GetRCurr());
     const Mat3x3 R2(pStructNode2->GetRCurr());
-    for (std::vector<Contact>::iterator it = contacts.begin(); it != contacts.end(); it++) {
-        const Vec3 Rf1(R1 * it->f1);
-        const Vec3 Rf2(R2 * it->f2);
+    ContactBuffer& c(*pBuffer);
+    for (std::size_t i = iFirst; i < iFirst + iNumContacts; i++) {
+        const Vec3 Rf1(R1 * c.f1[i]);
+        const Vec3 Rf2(R2 * c.f2[i]);
         Vec3 normal = pNode2->GetXCurr() + Rf2 - pNode1->GetXCurr() - Rf1;
         const doublereal depth = normal.Norm();
+        c.tangent[i] = Zero3;
         if (std::numeric_limits<doublereal>::epsilon() < depth) {
             normal /= depth;
-            const Vec3 R_Arm1(R1 * it->Arm1);
+            const Vec3 R_Arm1(R1 * c.Arm1[i]);
             const Vec3 R_Arm2(pNode1->GetXCurr() + R_Arm1 - pNode2->GetXCurr());
             Vec3 Vt(pNode2->GetVCurr() + (pStructNode2->GetWCurr()).Cross(R_Arm2) - pNode1->GetVCurr() - (pStructNode1->GetWCurr()).Cross(R_Arm1));
             Vt -= normal * Vt.Dot(normal);
             if (std::numeric_limits<doublereal>::epsilon() < Vt.Norm()) {
-                tangents.push_back(Vt / Vt.Norm());
-            } else {
-                tangents.push_back(Zero3);
+                c.tangent[i] = Vt / Vt.Norm();
             }
-        } else {
-            tangents.push_back(Zero3);
         }
+        history[i - iFirst].f1 = c.f1[i];
+        history[i - iFirst].tangent = c.tangent[i];
+        history[i - iFirst].s1 = c.s1[i];
+        history[i - iFirst].s2 = c.s2[i];
     }
-    if (tangents.size() == contacts.size()) {
-        for (int i = 0; i < tangents.size(); i++) {
-            contacts[i].tangent = tangents[i];
-        }
+}
+
+void
+Collision::SetBlock(const StructDispNode* pBlockNode1, integer iBlockRow, integer iBlockCol)
+{
+    /* the block is laid out for pBlockNode1 first, whatever the order of this pair */
+    if (pNode1 == pBlockNode1) {
+        iR1 = iBlockRow;
+        iC1 = iBlockCol;
+        iR2 = iBlockRow + iNumRowsNode;
+        iC2 = iBlockCol + iNumColsNode;
+    } else {
+        iR1 = iBlockRow + iNumRowsNode;
+        iC1 = iBlockCol + iNumColsNode;
+        iR2 = iBlockRow;
+        iC2 = iBlockCol;
     }
 }
 
-VariableSubMatrixHandler&
-Collision::AssJac(VariableSubMatrixHandler& WorkMat,
-    doublereal dCoef,
-    const VectorHandler& XCurr,
-    const VectorHandler& XPrimeCurr)
+void
+Collision::AssJac(FullSubMatrixHandler& WM, doublereal dCoef)
 {
     DEBUGCOUT("Entering Collision::AssJac()" << std::endl);
-    FullSubMatrixHandler& WM = WorkMat.SetFull();
-    const integer iNode1FirstPosIndex = pNode1->iGetFirstPositionIndex();
-    const integer iNode1FirstMomIndex = pNode1->iGetFirstMomentumIndex();
-    const integer iNode2FirstPosIndex = pNode2->iGetFirstPositionIndex();
-    const integer iNode2FirstMomIndex = pNode2->iGetFirstMomentumIndex();
-    for (int iCnt = 1; iCnt <= iNumRowsNode; iCnt++) {
-        WM.PutRowIndex(iR + iCnt, iNode1FirstMomIndex + iCnt);
-        WM.PutRowIndex(iR + iNumRowsNode + iCnt, iNode2FirstMomIndex + iCnt);
+    iNumClosed = iGetNumClosedContacts();
+    for (std::size_t i = iFirst; i < iFirst + iNumContacts; i++) {
+        AssMat(WM, dCoef, i);
     }
-    for (int iCnt = 1; iCnt <= iNumColsNode; iCnt++) {
-        WM.PutColIndex(iC + iCnt, iNode1FirstPosIndex + iCnt);
-        WM.PutColIndex(iC + iNumColsNode + iCnt, iNode2FirstPosIndex + iCnt);
+}
+
+integer
+Collision::iGetNumClosedContacts(void) const
+{
+    /* the normal force is shared among the contacts that are not speculative */
+    if (dMargin == 0.) {
+        return iNumContacts;
     }
-    for (std::vector<Contact>::iterator it = contacts.begin(); it != contacts.end(); it++) {
-        AssMat(WM, dCoef, *it);
+    const Mat3x3 R1(dynamic_cast<const StructNode *>(pNode1)->GetRCurr());
+    const Mat3x3 R2(dynamic_cast<const StructNode *>(pNode2)->GetRCurr());
+    const ContactBuffer& c(*pBuffer);
+    integer iNum(0);
+    for (std::size_t i = iFirst; i < iFirst + iNumContacts; i++) {
+        if ((pNode2->GetXCurr() + R2 * c.f2[i] - pNode1->GetXCurr() - R1 * c.f1[i]).Norm() > dMargin) {
+            iNum++;
+        }
     }
-    return WorkMat;
+    return iNum;
 }
 
 void
-Collision::AssMat(FullSubMatrixHandler& WM, doublereal dCoef, Contact& contact)
+Collision::AssMat(FullSubMatrixHandler& WM, doublereal dCoef, std::size_t i)
 {
     const StructNode* pStructNode1(dynamic_cast<const StructNode *>(pNode1));
     const StructNode* pStructNode2(dynamic_cast<const StructNode *>(pNode2));
     const Mat3x3 R1(pStructNode1->GetRCurr());
     const Mat3x3 R2(pStructNode2->GetRCurr());
+    const ContactBuffer& c(*pBuffer);
     
     /* Impact */
-    const Vec3 Rf1(R1 * contact.f1);
-    const Vec3 Rf2(R2 * contact.f2);
+    const Vec3 Rf1(R1 * c.f1[i]);
+    const Vec3 Rf2(R2 * c.f2[i]);
     Vec3 normal = pNode2->GetXCurr() + Rf2 - pNode1->GetXCurr() - Rf1;
     const doublereal depth = normal.Norm();
     if (std::numeric_limits<doublereal>::epsilon() < depth) {
@@ -208,15 +560,23 @@ Collision::AssMat(FullSubMatrixHandler& WM, doublereal dCoef, Contact& contact)
         return;
     }
     const Vec3 V(pNode2->GetVCurr() + (pStructNode2->GetWCurr()).Cross(Rf2) - pNode1->GetVCurr() - (pStructNode1->GetWCurr()).Cross(Rf1));
+    if (depth <= dMargin) {
+        /* speculative contact: no force until it closes */
+        return;
+    }
     const doublereal Vn_Norm = V.Dot(normal);
-    ConstitutiveLaw1DOwner::Update(depth, Vn_Norm);
-    doublereal Fn_Norm = GetF() / contacts.size();
-    doublereal FDEPrime = GetFDEPrime();
+    doublereal Fn_Norm;
+    doublereal FDE;
+    doublereal FDEPrime;
+    pMaterial->Evaluate(depth - dMargin, Vn_Norm, Fn_Norm, FDE, FDEPrime);
+    Fn_Norm /= iNumClosed;
+    FDE /= iNumClosed;
+    FDEPrime /= iNumClosed;
 
     /* Vettore forza */
     const Vec3 Fn = normal * Fn_Norm;
 
-    Mat3x3 K(normal.Tens() * (dCoef * (GetFDE() + (normal.Dot(V) * FDEPrime - Fn_Norm) / depth)));
+    Mat3x3 K(normal.Tens() * (dCoef * (FDE - (Vn_Norm * FDEPrime + Fn_Norm) / depth)));
     if (FDEPrime != 0.) {
         K += normal.Tens(V) * (dCoef * FDEPrime / depth);
     }
@@ -235,94 +595,249 @@ Collision::AssMat(FullSubMatrixHandler& WM, doublereal dCoef, Contact& contact)
     if (FDEPrime != 0.) {
         Tmp1 += KPrime;
     }
-    WM.Add(iR + 1, iC + 1, Tmp1);
-    WM.Add(iR + 7, iC + 7, Tmp1);
+    WM.Add(iR1 + 1, iC1 + 1, Tmp1);
+    WM.Add(iR2 + 1, iC2 + 1, Tmp1);
 
     /* Termini di coppia, nodo 1 */
     Mat3x3 Tmp2 = Rf1.Cross(Tmp1);
-    WM.Add(iR + 4, iC + 1, Tmp2);
-    WM.Sub(iR + 4, iC + 7, Tmp2);
+    WM.Add(iR1 + 4, iC1 + 1, Tmp2);
+    WM.Sub(iR1 + 4, iC2 + 1, Tmp2);
 
     /* Termini di coppia, nodo 2 */
     Tmp2 = Rf2.Cross(Tmp1);
-    WM.Add(iR + 10, iC + 7, Tmp2);
-    WM.Sub(iR + 10, iC + 1, Tmp2);
+    WM.Add(iR2 + 4, iC2 + 1, Tmp2);
+    WM.Sub(iR2 + 4, iC1 + 1, Tmp2);
 
     /* termini di forza extradiagonali */
-    WM.Sub(iR + 1, iC + 7, Tmp1);
-    WM.Sub(iR + 7, iC + 1, Tmp1);
+    WM.Sub(iR1 + 1, iC2 + 1, Tmp1);
+    WM.Sub(iR2 + 1, iC1 + 1, Tmp1);
 
     /* Termini di rotazione, Delta g1 */
     Mat3x3 Tmp3 = Tmp1 * Mat3x3(MatCross, -Rf1);
     if (FDEPrime != 0.) {
         Tmp3 += KPrime * Mat3x3(MatCross, Rf1.Cross((pStructNode1->GetWRef()) * dCoef));
     }
-    WM.Add(iR + 1, iC + 4, Tmp3);
-    WM.Sub(iR + 7, iC + 4, Tmp3);
+    WM.Add(iR1 + 1, iC1 + 4, Tmp3);
+    WM.Sub(iR2 + 1, iC1 + 4, Tmp3);
 
     /* Termini di coppia, Delta g1 */
     Tmp2 = Rf1.Cross(Tmp3) + Mat3x3(MatCrossCross, Fn, Rf1 * dCoef);
-    WM.Add(iR + 4, iC + 4, Tmp2);
+    WM.Add(iR1 + 4, iC1 + 4, Tmp2);
     Tmp2 = Rf2.Cross(Tmp3);
-    WM.Sub(iR + 10, iC + 4, Tmp2);
+    WM.Sub(iR2 + 4, iC1 + 4, Tmp2);
 
     /* Termini di rotazione, Delta g2 */
     Tmp3 = Tmp1*Mat3x3(MatCross, -Rf2);
     if (FDEPrime != 0.) {
         Tmp3 += KPrime * Mat3x3(MatCross, Rf2.Cross((pStructNode2->GetWRef()) * dCoef));
     }
-    WM.Add(iR + 7, iC + 10, Tmp3);
-    WM.Sub(iR + 1, iC + 10, Tmp3);
+    WM.Add(iR2 + 1, iC2 + 4, Tmp3);
+    WM.Sub(iR1 + 1, iC2 + 4, Tmp3);
 
     /* Termini di coppia, Delta g2 */
     Tmp2 = Rf2.Cross(Tmp3) + Mat3x3(MatCrossCross, Fn, Rf2 * dCoef);
-    WM.Add(iR + 10, iC + 10, Tmp2);
+    WM.Add(iR2 + 4, iC2 + 4, Tmp2);
     Tmp2 = Rf1.Cross(Tmp3);
-    WM.Sub(iR + 4, iC + 10, Tmp2);
+    WM.Sub(iR1 + 4, iC2 + 4, Tmp2);
 
     /* Resistance */
+    const BasicScalarFunction* pSF(pMaterial->pSF);
+    const doublereal dStickStiffness(pMaterial->dStickStiffness);
     if (pSF != NULL) {
-        const Vec3 R_Arm1(R1 * contact.Arm1);
+        const Vec3 R_Arm1(R1 * c.Arm1[i]);
         const Vec3 R_Arm2(pNode1->GetXCurr() + R_Arm1 - pNode2->GetXCurr());
-        const doublereal Ft_Norm_max = (*pSF)((V - normal * Vn_Norm).Norm()) * contact.Fn_Norm;
-        Vec3 Ft = contact.tangent * Ft_Norm_max;
-        WM.Sub(iR + 4, iC + 4, Mat3x3(MatCrossCross, Ft * dCoef, R_Arm1));
-        WM.Add(iR + 10, iC + 10, Mat3x3(MatCrossCross, Ft * dCoef, R_Arm2));
+        const Vec3 Vt(V - normal * Vn_Norm);
+        const doublereal Vt_Norm(Vt.Norm());
+        const doublereal mu((*pSF)(Vt_Norm));
+
+        /* Fn_Norm varies as a.dD + b.dV, where D = x2 + Rf2 - x1 - Rf1 */
+        const Mat3x3 P(Eye3 - normal.Tens());
+        const Mat3x3 Nd(P / depth);
+        const Vec3 a(normal * FDE + Nd * V * FDEPrime);
+        const Vec3 b(normal * FDEPrime);
+
+        /* Ft varies as Cd dD + Cv dV + Ca dA, where A = x2 + Rs2 - x1 - Rs1 spans the stick spring */
+        Vec3 tangent(c.tangent[i]);
+        if (std::numeric_limits<doublereal>::epsilon() < Vt_Norm) {
+            tangent = Vt / Vt_Norm;
+        }
+        const doublereal dMuDiff(std::numeric_limits<doublereal>::epsilon() < Vt_Norm ? pMaterial->dGetFrictionDiff(Vt_Norm) : 0.);
+        const Mat3x3 Q((Eye3 * Vn_Norm + normal.Tens(V)) * Nd * -1.);
+        Vec3 Ft(Zero3);
+        Mat3x3 Cd(Zero3x3);
+        Mat3x3 Cv(Zero3x3);
+        Mat3x3 Ca(Zero3x3);
+        Vec3 Rs1(Zero3);
+        Vec3 Rs2(Zero3);
+        if (dStickStiffness > 0.) {
+            Rs1 = R1 * c.s1[i];
+            Rs2 = R2 * c.s2[i];
+            const Vec3 A(pNode2->GetXCurr() + Rs2 - pNode1->GetXCurr() - Rs1);
+            const Vec3 T((A - normal * A.Dot(normal)) * dStickStiffness);
+            const doublereal T_Norm(T.Norm());
+            const doublereal Ft_Norm_max(std::max(mu * Fn_Norm, 0.));
+
+            /* T varies as Ca dA + B dD through the spring and the tangent plane */
+            Ca = P * dStickStiffness;
+            const Mat3x3 B((Eye3 * A.Dot(normal) + normal.Tens(A)) * Nd * -dStickStiffness);
+            if (T_Norm > Ft_Norm_max) {
+                if (Ft_Norm_max == 0.) {
+                    return;
+                }
+                /* slip: Ft = mu Fn e, with e = T / |T| */
+                const Vec3 e(T / T_Norm);
+                const Mat3x3 E((Eye3 - e.Tens()) * (Ft_Norm_max / T_Norm));
+                Ft = e * Ft_Norm_max;
+                Cd = e.Tens(a) * mu + e.Tens(tangent) * Q * (dMuDiff * Fn_Norm) + E * B;
+                Cv = e.Tens(b) * mu + e.Tens(tangent) * P * (dMuDiff * Fn_Norm);
+                Ca = E * Ca;
+            } else {
+                /* stick: Ft = T */
+                Ft = T;
+                Cd = B;
+            }
+        } else {
+            Cd = tangent.Tens(a) * mu;
+            Cv = tangent.Tens(b) * mu;
+            if (std::numeric_limits<doublereal>::epsilon() < Vt_Norm) {
+                /* slip direction and friction coefficient vary with dVt = P dV + Q dD */
+                const Mat3x3 M((Eye3 - tangent.Tens()) * (mu * Fn_Norm / Vt_Norm)
+                    + tangent.Tens() * (dMuDiff * Fn_Norm));
+                Cv += M * P;
+                Cd += M * Q;
+            }
+            Ft = tangent * (mu * Fn_Norm);
+        }
+        const Mat3x3 KF(Cv + (Cd + Ca) * dCoef);
+        const Mat3x3 G1((Cd * Mat3x3(MatCross, -Rf1) + Ca * Mat3x3(MatCross, -Rs1)) * dCoef
+            + Cv * Mat3x3(MatCross, -Rf1) + Cv * Mat3x3(MatCross, Rf1.Cross((pStructNode1->GetWRef()) * dCoef)));
+        const Mat3x3 G2((Cd * Mat3x3(MatCross, Rf2) + Ca * Mat3x3(MatCross, Rs2)) * dCoef
+            + Cv * Mat3x3(MatCross, Rf2) - Cv * Mat3x3(MatCross, Rf2.Cross((pStructNode2->GetWRef()) * dCoef)));
+
+        /* Termini di forza */
+        WM.Add(iR1 + 1, iC1 + 1, KF);
+        WM.Sub(iR1 + 1, iC2 + 1, KF);
+        WM.Add(iR1 + 1, iC1 + 4, G1);
+        WM.Add(iR1 + 1, iC2 + 4, G2);
+        WM.Sub(iR2 + 1, iC1 + 1, KF);
+        WM.Add(iR2 + 1, iC2 + 1, KF);
+        WM.Sub(iR2 + 1, iC1 + 4, G1);
+        WM.Sub(iR2 + 1, iC2 + 4, G2);
+
+        /* Termini di coppia, nodo 1: R_Arm1 x Ft */
+        WM.Add(iR1 + 4, iC1 + 1, R_Arm1.Cross(KF));
+        WM.Sub(iR1 + 4, iC2 + 1, R_Arm1.Cross(KF));
+        WM.Add(iR1 + 4, iC1 + 4, R_Arm1.Cross(G1) - Mat3x3(MatCrossCross, Ft * dCoef, R_Arm1));
+        WM.Add(iR1 + 4, iC2 + 4, R_Arm1.Cross(G2));
+
+        /* Termini di coppia, nodo 2: -R_Arm2 x Ft, with R_Arm2 = x1 + R_Arm1 - x2 */
+        WM.Sub(iR2 + 4, iC1 + 1, R_Arm2.Cross(KF) + Mat3x3(MatCross, Ft * dCoef));
+        WM.Add(iR2 + 4, iC2 + 1, R_Arm2.Cross(KF) + Mat3x3(MatCross, Ft * dCoef));
+        WM.Sub(iR2 + 4, iC1 + 4, R_Arm2.Cross(G1) - Mat3x3(MatCrossCross, Ft * dCoef, R_Arm1));
+        WM.Sub(iR2 + 4, iC2 + 4, R_Arm2.Cross(G2));
     }
 }
 
-SubVectorHandler& 
-Collision::AssRes(SubVectorHandler& WorkVec,
-    doublereal dCoef,
-    const VectorHandler& XCurr, 
-    const VectorHandler& XPrimeCurr)
+CollisionMaterial::CollisionMaterial(const ConstitutiveLaw1D* pCL, const BasicScalarFunction* pSF,
+    doublereal penetration_ratio, doublereal dStickStiffness, bool bGeneric)
+: pSF(pSF),
+penetration_ratio(penetration_ratio),
+dStickStiffness(dStickStiffness),
+iMaxContacts(4),
+pCL(const_cast<ConstitutiveLaw1D*>(pCL)),
+law(CONTACT_LAW_GENERIC)
 {
-    DEBUGCOUT("Entering Collision::AssRes()" << std::endl);
-    integer iNode1FirstMomIndex = pNode1->iGetFirstMomentumIndex();
-    integer iNode2FirstMomIndex = pNode2->iGetFirstMomentumIndex();
+    ASSERT(pCL != NULL);
+    law_params[0] = law_params[1] = law_params[2] = 0.;
+    if (bGeneric) {
+        return;
+    }
+    /* K and C are set by the constructor; a zero prestrain leaves F = prestress at rest */
+    typedef LinearViscoElasticConstitutiveLaw<doublereal, doublereal> LinearLaw;
+    LinearLaw* pLinear(dynamic_cast<LinearLaw*>(this->pCL));
+    if (pLinear != NULL && dynamic_cast<const ZeroTplDriveCaller<doublereal>*>(pLinear->pGetDriveCaller()) != NULL) {
+        pLinear->Update(0., 0.);
+        if (pLinear->GetF() == 0.) {
+            law = CONTACT_LAW_LINEAR;
+            law_params[0] = pLinear->GetFDE();
+            law_params[1] = pLinear->GetFDEPrime();
+        }
+    }
+}
 
-    for (int iCnt = 1; iCnt <= iNumRowsNode; iCnt++) {
-      WorkVec.PutRowIndex(iR + iCnt, iNode1FirstMomIndex + iCnt);
-      WorkVec.PutRowIndex(iR + iNumRowsNode + iCnt, iNode2FirstMomIndex + iCnt);
+CollisionMaterial::CollisionMaterial(doublereal K, doublereal e, doublereal C, const BasicScalarFunction* pSF,
+    doublereal penetration_ratio, doublereal dStickStiffness)
+: pSF(pSF),
+penetration_ratio(penetration_ratio),
+dStickStiffness(dStickStiffness),
+iMaxContacts(4),
+pCL(NULL),
+law(CONTACT_LAW_HERTZ)
+{
+    law_params[0] = K;
+    law_params[1] = e;
+    law_params[2] = C;
+}
+
+CollisionMaterial::~CollisionMaterial(void)
+{
+    delete pCL;
+}
+
+void
+CollisionMaterial::Evaluate(doublereal depth, doublereal Vn, doublereal& F, doublereal& FDE, doublereal& FDEPrime)
+{
+    switch (law) {
+    case CONTACT_LAW_LINEAR:
+        ContactLaw<CONTACT_LAW_LINEAR>::Evaluate(law_params, depth, Vn, F, FDE, FDEPrime);
+        break;
+    case CONTACT_LAW_HERTZ:
+        ContactLaw<CONTACT_LAW_HERTZ>::Evaluate(law_params, depth, Vn, F, FDE, FDEPrime);
+        break;
+    default:
+        /* the law only caches its last evaluation, so pairs can share it while assembly is serial */
+        pCL->Update(depth, Vn);
+        F = pCL->GetF();
+        FDE = pCL->GetFDE();
+        FDEPrime = pCL->GetFDEPrime();
+        break;
     }
-    for (std::vector<Contact>::iterator it = contacts.begin(); it != contacts.end(); it++) {
-        AssVec(WorkVec, dCoef, *it);
+}
+
+doublereal
+CollisionMaterial::dGetFrictionDiff(doublereal v) const
+{
+    const DifferentiableScalarFunction* pDSF(dynamic_cast<const DifferentiableScalarFunction*>(pSF));
+    if (pDSF != NULL) {
+        return pDSF->ComputeDiff(v);
     }
-    return WorkVec;
+    const doublereal h(std::max(v, 1.) * std::sqrt(std::numeric_limits<doublereal>::epsilon()));
+    return ((*pSF)(v + h) - (*pSF)(v)) / h;
 }
 
 void
-Collision::AssVec(SubVectorHandler& WorkVec, doublereal dCoef, Contact& contact)
+Collision::AssRes(SubVectorHandler& WorkVec, doublereal dCoef)
+{
+    DEBUGCOUT("Entering Collision::AssRes()" << std::endl);
+    iNumClosed = iGetNumClosedContacts();
+    for (std::size_t i = iFirst; i < iFirst + iNumContacts; i++) {
+        AssVec(WorkVec, dCoef, i);
+    }
+}
+
+void
+Collision::AssVec(SubVectorHandler& WorkVec, doublereal dCoef, std::size_t i)
 {
     DEBUGCOUT("RodWithOffset::AssVec()" << std::endl);
     const StructNode* pStructNode1(dynamic_cast<const StructNode *>(pNode1));
     const StructNode* pStructNode2(dynamic_cast<const StructNode *>(pNode2));
     const Mat3x3 R1(pStructNode1->GetRCurr());
     const Mat3x3 R2(pStructNode2->GetRCurr());
+    ContactBuffer& c(*pBuffer);
     
     /* Impact */
-    const Vec3 Rf1(R1 * contact.f1);
-    const Vec3 Rf2(R2 * contact.f2);
+    const Vec3 Rf1(R1 * c.f1[i]);
+    const Vec3 Rf2(R2 * c.f2[i]);
     Vec3 normal = pNode2->GetXCurr() + Rf2 - pNode1->GetXCurr() - Rf1;
     const doublereal depth = normal.Norm();
     if (std::numeric_limits<doublereal>::epsilon() < depth) {
@@ -331,179 +846,1105 @@ Collision::AssVec(SubVectorHandler& WorkVec, doublereal dCoef, Contact& contact)
         return;
     }
     const Vec3 V(pNode2->GetVCurr() + (pStructNode2->GetWCurr()).Cross(Rf2) - pNode1->GetVCurr() - (pStructNode1->GetWCurr()).Cross(Rf1));
+    if (depth <= dMargin) {
+        c.Fn_Norm[i] = 0.;
+        c.Ft[i] = Zero3;
+        c.bSlip[i] = false;
+        return;
+    }
     const doublereal Vn_Norm = V.Dot(normal);
-    ConstitutiveLaw1DOwner::Update(depth, Vn_Norm);
-    contact.Fn_Norm = GetF() / contacts.size();
-    const Vec3 Fn(normal * contact.Fn_Norm);
-    WorkVec.Add(iR + 1, Fn);
-    WorkVec.Add(iR + 4, Rf1.Cross(Fn));
-    WorkVec.Sub(iR + 7, Fn);
-    WorkVec.Sub(iR + 10, Rf2.Cross(Fn));
+    doublereal FDE;
+    doublereal FDEPrime;
+    pMaterial->Evaluate(depth - dMargin, Vn_Norm, c.Fn_Norm[i], FDE, FDEPrime);
+    c.Fn_Norm[i] /= iNumClosed;
+    const Vec3 Fn(normal * c.Fn_Norm[i]);
+    WorkVec.Add(iR1 + 1, Fn);
+    WorkVec.Add(iR1 + 4, Rf1.Cross(Fn));
+    WorkVec.Sub(iR2 + 1, Fn);
+    WorkVec.Sub(iR2 + 4, Rf2.Cross(Fn));
 
     /* Resistance */
+    const BasicScalarFunction* pSF(pMaterial->pSF);
+    const doublereal dStickStiffness(pMaterial->dStickStiffness);
     if (pSF != NULL) {
-        const Vec3 R_Arm1(R1 * contact.Arm1);
+        const Vec3 R_Arm1(R1 * c.Arm1[i]);
         const Vec3 R_Arm2(pNode1->GetXCurr() + R_Arm1 - pNode2->GetXCurr());
-        const doublereal Ft_Norm_max = (*pSF)((V - normal * Vn_Norm).Norm()) * contact.Fn_Norm;
-        contact.Ft = contact.tangent * Ft_Norm_max;
-        WorkVec.Add(iR + 1, contact.Ft);
-        WorkVec.Add(iR + 4, R_Arm1.Cross(contact.Ft));
-        WorkVec.Sub(iR + 7, contact.Ft);
-        WorkVec.Sub(iR + 10, R_Arm2.Cross(contact.Ft));
+        /* the stored tangent is the fallback when there is no slip to give a direction */
+        const Vec3 Vt(V - normal * Vn_Norm);
+        const doublereal Vt_Norm(Vt.Norm());
+        const Vec3 tangent(std::numeric_limits<doublereal>::epsilon() < Vt_Norm ? Vt / Vt_Norm : c.tangent[i]);
+        const doublereal Ft_Norm_max = (*pSF)(Vt_Norm) * c.Fn_Norm[i];
+        if (dStickStiffness > 0.) {
+            /* tangential spring between the stick anchors, capped at the Coulomb limit */
+            const Vec3 A(pNode2->GetXCurr() + R2 * c.s2[i] - pNode1->GetXCurr() - R1 * c.s1[i]);
+            const Vec3 T((A - normal * A.Dot(normal)) * dStickStiffness);
+            const doublereal T_Norm(T.Norm());
+            c.bSlip[i] = (T_Norm > std::max(Ft_Norm_max, 0.));
+            c.Ft[i] = c.bSlip[i] ? T * (std::max(Ft_Norm_max, 0.) / T_Norm) : T;
+        } else {
+            c.Ft[i] = tangent * Ft_Norm_max;
+        }
+        WorkVec.Add(iR1 + 1, c.Ft[i]);
+        WorkVec.Add(iR1 + 4, R_Arm1.Cross(c.Ft[i]));
+        WorkVec.Sub(iR2 + 1, c.Ft[i]);
+        WorkVec.Sub(iR2 + 4, R_Arm2.Cross(c.Ft[i]));
     } else {
-        contact.Ft = Zero3;
+        c.Ft[i] = Zero3;
     }
 }
 
-std::ostream&
-Collision::OutputAppend(std::ostream& out) const {
-    for (std::vector<Contact>::const_iterator it = contacts.begin(); it != contacts.end(); it++) {
-        out << " " << pNode1->GetLabel();
-        out << " " << pNode2->GetLabel();
-        for (int iCnt = 1; iCnt <= 3; iCnt++) {
-            out << " " << it->f1(iCnt);
-        }
-        for (int iCnt = 1; iCnt <= 3; iCnt++) {
-            out << " " << it->f2(iCnt);
-        }
-        for (int iCnt = 1; iCnt <= 3; iCnt++) {
-            out << " " << it->Ft(iCnt);
+void
+Collision::StreamAppend(std::vector<ContactStreamRecord>& records) const
+{
+    const Mat3x3 R1(dynamic_cast<const StructNode *>(pNode1)->GetRCurr());
+    const Mat3x3 R2(dynamic_cast<const StructNode *>(pNode2)->GetRCurr());
+    const ContactBuffer& c(*pBuffer);
+    for (std::size_t i = iFirst; i < iFirst + iNumContacts; i++) {
+        ContactStreamRecord record;
+        std::memset(&record, 0, sizeof(record));
+        record.label1 = pNode1->GetLabel();
+        record.label2 = pNode2->GetLabel();
+        for (int iCnt = 0; iCnt < 3; iCnt++) {
+            record.f1[iCnt] = c.f1[i](iCnt + 1);
+            record.f2[iCnt] = c.f2[i](iCnt + 1);
+            record.Ft[iCnt] = c.Ft[i](iCnt + 1);
         }
-        out << " " << it->Fn_Norm;
-        // If desired, must recalculate depth and Vn_Norm
-        //ConstitutiveLaw1DOwner::Update(depth, Vn_Norm);
-        //ConstitutiveLaw1DOwner::OutputAppend(out);
+        record.Fn = c.Fn_Norm[i];
+        record.depth = (pNode2->GetXCurr() + R2 * c.f2[i] - pNode1->GetXCurr() - R1 * c.f1[i]).Norm() - dMargin;
+        records.push_back(record);
     }
 }
 
-bool CollisionFunction(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* cdata_)
+void
+Collision::GetContactState(std::vector<integer>& state, std::vector<doublereal>& depths) const
 {
-    std::map<const FCL::ObjectPair, Collision*> objectpair_collision_map(
-        *(static_cast<std::map<const FCL::ObjectPair, Collision*>*>(cdata_)));
-    FCL::ObjectPair object_pair(o1, o2);
-    if (objectpair_collision_map.count(object_pair) == 0) {
-        std::swap(object_pair.first, object_pair.second);
-        if (objectpair_collision_map.count(object_pair) == 0) {
-            return false;
-        }
+    const Mat3x3 R1(dynamic_cast<const StructNode *>(pNode1)->GetRCurr());
+    const Mat3x3 R2(dynamic_cast<const StructNode *>(pNode2)->GetRCurr());
+    const ContactBuffer& c(*pBuffer);
+    state.push_back(iNumContacts);
+    for (std::size_t i = iFirst; i < iFirst + iNumContacts; i++) {
+        state.push_back(c.bSlip[i]);
+        depths.push_back((pNode2->GetXCurr() + R2 * c.f2[i] - pNode1->GetXCurr() - R1 * c.f1[i]).Norm() - dMargin);
     }
-    objectpair_collision_map[object_pair]->Intersect();
-    return false;
 }
 
+std::ostream&
+Collision::OutputAppend(std::ostream& out, std::size_t i) const {
+    const ContactBuffer& c(*pBuffer);
+    out << " " << pNode1->GetLabel();
+    out << " " << pNode2->GetLabel();
+    for (int iCnt = 1; iCnt <= 3; iCnt++) {
+        out << " " << c.f1[i](iCnt);
+    }
+    for (int iCnt = 1; iCnt <= 3; iCnt++) {
+        out << " " << c.f2[i](iCnt);
+    }
+    for (int iCnt = 1; iCnt <= 3; iCnt++) {
+        out << " " << c.Ft[i](iCnt);
+    }
+    out << " " << c.Fn_Norm[i];
+    // If desired, must recalculate depth and Vn_Norm
+    //ConstitutiveLaw1DOwner::Update(depth, Vn_Norm);
+    //ConstitutiveLaw1DOwner::OutputAppend(out);
+    return out;
+}
 
-// CollisionWorld: begin
 
-CollisionWorld::CollisionWorld(
-    unsigned uLabel, const DofOwner *pDO,
-    DataManager* pDM, MBDynParser& HP)
-: Elem(uLabel, flag(0)),
-UserDefinedElem(uLabel, pDO)
+CollisionBlock::CollisionBlock(const StructDispNode* pNode1, const StructDispNode* pNode2)
+: pNode1(pNode1),
+pNode2(pNode2),
+bSleeping(false),
+bFrozenRes(false),
+bFrozenJac(false),
+dFrozenCoef(0.0),
+dJacobianTolerance(-1.0)
 {
-    if (HP.IsKeyWord("help")) {
-        silent_cout(
-            "\n"
-            "Module:     Collision\n"
-            "\n"
-            "    This element implements a collision world\n"
-            "\n"
-            "    collision world,\n"
-            "       [material pairs,] (integer)<number_of_material_pairs>,\n"
-            "           <material_pair> [,...]\n"
-            "       [collision objects,] (integer)<number_of_collision_objects>,\n"
-            "           (CollisionObject) <label> [,...]\n"
-            "\n"
-            "    <material_pair> ::= (str)<material1>, (str)<material2>, (ConstitutiveLaw<1D>)<const_law>\n"
-            "       [, friction function, (ScalarFunction)<SF>, [, penetration ratio, (real)<penetration_ratio>]]\n"
-            "\n\n"
-            << std::endl);
+    NO_OP;
+}
 
-        if (!HP.IsArg()) {
-            /*
-             * Exit quietly if nothing else is provided
-             */
-            throw NoErr(MBDYN_EXCEPT_ARGS);
-        }
-    }
-    ConstLawType::Type VECLType(ConstLawType::VISCOELASTIC);
-    typedef std::pair<std::string, std::string> MaterialPair;
-    std::map<MaterialPair, ConstitutiveLaw1D*> pCL;
-    std::map<MaterialPair, const BasicScalarFunction*> pSF;
-    std::map<MaterialPair, doublereal> penetration_ratio;
-    HP.IsKeyWord("material" "pairs");
-    int N = HP.GetInt();
-    for (int i; i < N; i++) {
-        MaterialPair material_pair(std::make_pair(HP.GetValue(TypedValue::VAR_STRING).GetString(), HP.GetValue(TypedValue::VAR_STRING).GetString()));
-        pCL[material_pair] = HP.GetConstLaw1D(VECLType);
-        pSF[material_pair] = NULL;
-        penetration_ratio[material_pair] = 0.0;
-        if (HP.IsKeyWord("friction" "function")) {
-            pSF[material_pair] = ParseScalarFunction(HP, pDM);
-            if (HP.IsKeyWord("penetration" "ratio")) {
-                penetration_ratio[material_pair] = HP.GetReal();
-                if (material_pair.first == material_pair.second) {
-                    silent_cout("Identical material pair penetration ratio overridden to become 0.5" << std::endl);
-                }
-            }
+void
+CollisionBlock::Add(Collision* pCollision)
+{
+    pCollision->SetBlock(pNode1, 0, 0);
+    pairs.push_back(pCollision);
+    bFrozenRes = false;
+    bFrozenJac = false;
+}
+
+void
+CollisionBlock::Remove(Collision* pCollision)
+{
+    pairs.erase(std::remove(pairs.begin(), pairs.end(), pCollision), pairs.end());
+    /* what was captured included the contacts of this pair */
+    bFrozenRes = false;
+    bFrozenJac = false;
+}
+
+bool
+CollisionBlock::IsEmpty(void) const
+{
+    return pairs.empty();
+}
+
+std::size_t
+CollisionBlock::iGetMemory(void) const
+{
+    return sizeof(CollisionBlock) + pairs.capacity() * sizeof(Collision*)
+        + (frozen.capacity() + depths.capacity() + frozen_depths.capacity()) * sizeof(doublereal)
+        + (state.capacity() + frozen_state.capacity()) * sizeof(integer);
+}
+
+void
+CollisionBlock::SetJacobianTolerance(doublereal dTolerance)
+{
+    dJacobianTolerance = dTolerance;
+}
+
+bool
+CollisionBlock::IsJacobianCurrent(void)
+{
+    /* the frozen Jacobian holds while no contact appears, vanishes or slips, and depths stay close */
+    state.clear();
+    depths.clear();
+    for (std::vector<Collision*>::const_iterator it = pairs.begin(); it != pairs.end(); it++) {
+        (*it)->GetContactState(state, depths);
+    }
+    if (!bFrozenJac || state != frozen_state) {
+        return false;
+    }
+    for (std::size_t i = 0; i < depths.size(); i++) {
+        if (std::abs(depths[i] - frozen_depths[i]) > dJacobianTolerance) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+CollisionBlock::IsSleeping(void) const
+{
+    return bSleeping;
+}
+
+void
+CollisionBlock::SetSleeping(bool bSleep)
+{
+    if (bSleep != bSleeping) {
+        /* frozen contributions are captured at the first assembly after falling asleep */
+        bFrozenRes = false;
+        bFrozenJac = false;
+    }
+    bSleeping = bSleep;
+    for (std::vector<Collision*>::iterator it = pairs.begin(); it != pairs.end(); it++) {
+        (*it)->SetSleeping(bSleep);
+    }
+}
+
+CollisionNodeData*
+CollisionBlock::pGetNodeData1(void) const
+{
+    return pairs.front()->pGetNodeData1();
+}
+
+CollisionNodeData*
+CollisionBlock::pGetNodeData2(void) const
+{
+    return pairs.front()->pGetNodeData2();
+}
+
+void
+CollisionBlock::ClearContacts(void)
+{
+    for (std::vector<Collision*>::iterator it = pairs.begin(); it != pairs.end(); it++) {
+        (*it)->ClearContacts();
+    }
+}
+
+void
+CollisionBlock::Gather(ContactBuffer& to, std::vector<Collision*>& order, bool bKeep)
+{
+    /* sleeping pairs keep their contacts */
+    for (std::vector<Collision*>::iterator it = pairs.begin(); it != pairs.end(); it++) {
+        (*it)->Gather(to, order.size(), bKeep || (*it)->IsSleeping());
+        order.push_back(*it);
+    }
+}
+
+VariableSubMatrixHandler&
+CollisionBlock::AssJac(VariableSubMatrixHandler& WorkMat,
+    doublereal dCoef,
+    const VectorHandler& XCurr,
+    const VectorHandler& XPrimeCurr)
+{
+    DEBUGCOUT("Entering CollisionBlock::AssJac()" << std::endl);
+    FullSubMatrixHandler& WM = WorkMat.SetFull();
+    const integer iNode1FirstPosIndex = pNode1->iGetFirstPositionIndex();
+    const integer iNode1FirstMomIndex = pNode1->iGetFirstMomentumIndex();
+    const integer iNode2FirstPosIndex = pNode2->iGetFirstPositionIndex();
+    const integer iNode2FirstMomIndex = pNode2->iGetFirstMomentumIndex();
+    for (int iCnt = 1; iCnt <= iNumRowsNode; iCnt++) {
+        WM.PutRowIndex(iCnt, iNode1FirstMomIndex + iCnt);
+        WM.PutRowIndex(iNumRowsNode + iCnt, iNode2FirstMomIndex + iCnt);
+    }
+    for (int iCnt = 1; iCnt <= iNumColsNode; iCnt++) {
+        WM.PutColIndex(iCnt, iNode1FirstPosIndex + iCnt);
+        WM.PutColIndex(iNumColsNode + iCnt, iNode2FirstPosIndex + iCnt);
+    }
+    const int iNumRows(2 * iNumRowsNode);
+    const int iNumCols(2 * iNumColsNode);
+    const bool bFrozenMode(!bSleeping && dJacobianTolerance >= 0.0);
+    const bool bCurrent(bFrozenMode ? IsJacobianCurrent() : bSleeping);
+    if (bFrozenJac && dFrozenCoef == dCoef && bCurrent) {
+        for (int iRow = 1; iRow <= iNumRows; iRow++) {
+            for (int iCol = 1; iCol <= iNumCols; iCol++) {
+                WM.IncCoef(iRow, iCol, frozen[iNumRows + (iRow - 1) * iNumCols + iCol - 1]);
+            }
+        }
+        return WorkMat;
+    }
+    for (std::vector<Collision*>::iterator it = pairs.begin(); it != pairs.end(); it++) {
+        (*it)->AssJac(WM, dCoef);
+    }
+    if (bSleeping || bFrozenMode) {
+        /* the handler holds this block only */
+        frozen.resize(iNumRows + iNumRows * iNumCols);
+        for (int iRow = 1; iRow <= iNumRows; iRow++) {
+            for (int iCol = 1; iCol <= iNumCols; iCol++) {
+                frozen[iNumRows + (iRow - 1) * iNumCols + iCol - 1] = WM.dGetCoef(iRow, iCol);
+            }
+        }
+        dFrozenCoef = dCoef;
+        bFrozenJac = true;
+        if (bFrozenMode) {
+            frozen_state.swap(state);
+            frozen_depths.swap(depths);
+        }
+    }
+    return WorkMat;
+}
+
+SubVectorHandler&
+CollisionBlock::AssRes(SubVectorHandler& WorkVec,
+    doublereal dCoef,
+    const VectorHandler& XCurr,
+    const VectorHandler& XPrimeCurr)
+{
+    DEBUGCOUT("Entering CollisionBlock::AssRes()" << std::endl);
+    integer iNode1FirstMomIndex = pNode1->iGetFirstMomentumIndex();
+    integer iNode2FirstMomIndex = pNode2->iGetFirstMomentumIndex();
+
+    for (int iCnt = 1; iCnt <= iNumRowsNode; iCnt++) {
+      WorkVec.PutRowIndex(iCnt, iNode1FirstMomIndex + iCnt);
+      WorkVec.PutRowIndex(iNumRowsNode + iCnt, iNode2FirstMomIndex + iCnt);
+    }
+    const int iNumRows(2 * iNumRowsNode);
+    if (bSleeping && bFrozenRes) {
+        for (int iRow = 1; iRow <= iNumRows; iRow++) {
+            WorkVec.IncCoef(iRow, frozen[iRow - 1]);
+        }
+        return WorkVec;
+    }
+    for (std::vector<Collision*>::iterator it = pairs.begin(); it != pairs.end(); it++) {
+        (*it)->AssRes(WorkVec, dCoef);
+    }
+    if (bSleeping) {
+        frozen.resize(iNumRows + iNumRows * 2 * iNumColsNode);
+        for (int iRow = 1; iRow <= iNumRows; iRow++) {
+            frozen[iRow - 1] = WorkVec.dGetCoef(iRow);
+        }
+        bFrozenRes = true;
+    }
+    return WorkVec;
+}
+
+// CollisionWorld: begin
+
+CollisionWorld::CollisionWorld(
+    unsigned uLabel, const DofOwner *pDO,
+    DataManager* pDM, MBDynParser& HP)
+: Elem(uLabel, flag(0)),
+UserDefinedElem(uLabel, pDO),
+iWorkRows(0),
+pWorkVec(NULL),
+pWorkMat(NULL),
+block_vec(CollisionBlock::iBlockSize),
+block_mat(CollisionBlock::iBlockSize, CollisionBlock::iBlockSize, CollisionBlock::iBlockSize * CollisionBlock::iBlockSize)
+{
+    if (HP.IsKeyWord("help")) {
+        silent_cout(
+            "\n"
+            "Module:     Collision\n"
+            "\n"
+            "    This element implements a collision world\n"
+            "\n"
+            "    collision world,\n"
+            "       [material pairs,] (integer)<number_of_material_pairs>,\n"
+            "           <material_pair> [,...]\n"
+            "       [collision objects,] (integer)<number_of_collision_objects>,\n"
+            "           { (CollisionObject) | (CollisionParticles) } <label> [,...]\n"
+            "       [, broadphase, { dynamic aabb tree | grid [, threads, (integer)<threads>]\n"
+            "           | subdomains, (integer)<subdomains>\n"
+            "               [, { threads, (integer)<threads> | processes, (integer)<processes> }] }]\n"
+            "       [, sleep, (real)<linear_velocity>, (real)<angular_velocity>, (integer)<steps>]\n"
+            "       [, time step hint, (real)<max_penetration>, (real)<max_penetration_increment>,\n"
+            "           (real)<min_time_step>, (real)<max_time_step>]\n"
+            "       [, contact points, (integer)<max_points_per_pair>]\n"
+            "       [, stream, (str)<shm_name>, (integer)<capacity>]\n"
+            "       [, frozen jacobian, (real)<penetration_tolerance>]\n"
+            "       [, async broadphase [, (real)<inflation>]]\n"
+            "       [, active region, (Vec3)<min>, (Vec3)<max>]\n"
+            "\n"
+            "    <material_pair> ::= (str)<material1>, (str)<material2>,\n"
+            "       { (ConstitutiveLaw<1D>)<const_law> [, generic law]\n"
+            "       | hertz, (real)<K>, (real)<e>, (real)<C> }\n"
+            "       [, friction function, (ScalarFunction)<SF>, [, penetration ratio, (real)<penetration_ratio>]\n"
+            "           [, stick, (real)<tangential_stiffness>]]\n"
+            "\n"
+            "    The grid broadphase bins spheres in a uniform grid and tests any other\n"
+            "    shape against all objects; it is the default when all objects are spheres.\n"
+            "    The subdomains broadphase cuts space into slabs holding about as many\n"
+            "    objects each; objects crossing a boundary are ghosts in both slabs, and\n"
+            "    each slab keeps its own pairs and runs its own broadphase and narrowphase\n"
+            "    on a worker thread.  With processes, the slabs are searched and intersected\n"
+            "    instead by as many worker processes, forked from MBDyn at the first\n"
+            "    assembly, which keep the pairs of their slabs and their narrowphase\n"
+            "    state; poses and contacts go through memory shared with the solver.\n"
+            "    The workers are forked again when the set of active objects changes;\n"
+            "    processes cannot be used with async broadphase.\n"
+            "    Threads need a build with multithread support, otherwise one is used.\n"
+            "    A pair of objects, and the block of its two nodes, is made when the\n"
+            "    broadphase first reports it, and released at the first converged step\n"
+            "    it no longer does.\n"
+            "\n"
+            "    Contact islands whose nodes stay below both velocities for <steps>\n"
+            "    converged steps are put to sleep; their contacts are frozen until\n"
+            "    a moving body touches them.\n"
+            "\n"
+            "    With time step hint, each converged step recommends the next time step\n"
+            "    from the fastest approach velocity, the deepest penetration and whether\n"
+            "    a new contact appeared.  Private data: time_step, penetration,\n"
+            "    approach_velocity, new_contacts.  The private datum memory is the\n"
+            "    number of bytes held by pairs, their contacts and the material laws.\n"
+            "    The private data step_wall_time and collision_time are the wall time\n"
+            "    of the last converged step and the part of it spent in this element.\n"
+            "\n"
+            "    Each pair keeps at most <max_points_per_pair> contact points (default 4):\n"
+            "    the deepest one, then those farthest from the points already kept.\n"
+            "\n"
+            "    With stream, the contacts of each converged step are also published\n"
+            "    into the POSIX shared memory object <shm_name>, a ring of <capacity>\n"
+            "    records that the solver overwrites without waiting for readers;\n"
+            "    see contactstream.h for the layout and examples/ for a reader.\n"
+            "\n"
+            "    With stick, friction is a tangential spring anchored where the contact\n"
+            "    started sticking, limited by the friction function times the normal\n"
+            "    force; the anchor follows the sliding contact at each converged step.\n"
+            "\n"
+            "    The hertz law is depth^e (K + C Vn), with Hunt-Crossley damping.  It and\n"
+            "    a linear viscoelastic law without prestress or prestrain are evaluated\n"
+            "    inline; any other law, or one followed by generic law, is called as is.\n"
+            "\n"
+            "    With frozen jacobian, the contact block of each node pair is reused\n"
+            "    until a contact appears, vanishes or changes between stick and slip,\n"
+            "    or a penetration moves by more than <penetration_tolerance>; meant for\n"
+            "    modified Newton, where the Jacobian is refreshed only now and then.\n"
+            "\n"
+            "    With async broadphase, each converged step extrapolates every object\n"
+            "    over the next step from its node velocities, grown by <inflation>, and\n"
+            "    builds the candidate pairs of the swept bounds on a worker thread while\n"
+            "    the solver writes output and predicts; they are used from the next\n"
+            "    prediction on, unless an object leaves its swept bounds, in which case\n"
+            "    the broadphase runs as usual for the rest of the step.\n"
+            "\n"
+            "    Objects with an activation drive, and with active region all objects\n"
+            "    whose bounds leave the box <min>, <max>, are switched off at the\n"
+            "    converged step where that happens: they leave the broadphase and\n"
+            "    their pairs and workspace are released until they are switched on\n"
+            "    again.  Private data: active_objects.\n"
+            "\n\n"
+            << std::endl);
+
+        if (!HP.IsArg()) {
+            /*
+             * Exit quietly if nothing else is provided
+             */
+            throw NoErr(MBDYN_EXCEPT_ARGS);
+        }
+    }
+    ConstLawType::Type VECLType(ConstLawType::VISCOELASTIC);
+    HP.IsKeyWord("material" "pairs");
+    int N = HP.GetInt();
+    for (int i = 0; i < N; i++) {
+        MaterialPair material_pair(std::make_pair(HP.GetValue(TypedValue::VAR_STRING).GetString(), HP.GetValue(TypedValue::VAR_STRING).GetString()));
+        bool bHertz(false);
+        doublereal hertz_params[3];
+        const ConstitutiveLaw1D* pCL(NULL);
+        bool bGeneric(false);
+        if (HP.IsKeyWord("hertz")) {
+            bHertz = true;
+            for (int j = 0; j < 3; j++) {
+                hertz_params[j] = HP.GetReal();
+            }
+            if (hertz_params[0] <= 0.0 || hertz_params[1] < 1.0 || hertz_params[2] < 0.0) {
+                silent_cerr("collision world(" << GetLabel() << "): hertz law needs K > 0, e >= 1 and C >= 0 at line " << HP.GetLineData() << std::endl);
+                throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+            }
+        } else {
+            pCL = HP.GetConstLaw1D(VECLType);
+            bGeneric = HP.IsKeyWord("generic" "law");
+        }
+        const BasicScalarFunction* pSF(NULL);
+        doublereal penetration_ratio(0.0);
+        doublereal stick_stiffness(0.0);
+        if (HP.IsKeyWord("friction" "function")) {
+            pSF = ParseScalarFunction(HP, pDM);
+            if (HP.IsKeyWord("penetration" "ratio")) {
+                penetration_ratio = HP.GetReal();
+                if (material_pair.first == material_pair.second) {
+                    silent_cout("Identical material pair penetration ratio overridden to become 0.5" << std::endl);
+                }
+            }
             if (material_pair.first == material_pair.second) {
-                penetration_ratio[material_pair] = 0.5;
+                penetration_ratio = 0.5;
             }
+            if (HP.IsKeyWord("stick")) {
+                stick_stiffness = HP.GetReal();
+                if (stick_stiffness <= 0.0) {
+                    silent_cerr("collision world(" << GetLabel() << "): stick stiffness must be positive at line " << HP.GetLineData() << std::endl);
+                    throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+                }
+            }
+        }
+        if (material_pairs.find(material_pair) != material_pairs.end()) {
+            silent_cerr("collision world(" << GetLabel() << "): material pair (" << material_pair.first << ", " << material_pair.second << ") is defined twice at line " << HP.GetLineData() << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
         }
+        if (bHertz) {
+            material_pairs[material_pair] = new CollisionMaterial(hertz_params[0], hertz_params[1], hertz_params[2],
+                pSF, penetration_ratio, stick_stiffness);
+        } else {
+            material_pairs[material_pair] = new CollisionMaterial(pCL, pSF, penetration_ratio, stick_stiffness, bGeneric);
+        }
+        materials.push_back(material_pairs[material_pair]);
     }
     func_matrix = FCL::FuncMatrix();
-    std::set<CollisionObjectData*> all_objects;
-    std::set<CollisionObjectData*> objects;
-    iNumRows = 0;
-    iNumCols = 0;
+    /* objects of a material no pair is defined for touch nothing */
+    std::set<std::string> paired_materials;
+    for (std::map<MaterialPair, CollisionMaterial*>::const_iterator it = material_pairs.begin(); it != material_pairs.end(); it++) {
+        paired_materials.insert(it->first.first);
+        paired_materials.insert(it->first.second);
+    }
+    std::set<CollisionObjectData*> listed;
     HP.IsKeyWord("collision" "objects");
     N = HP.GetInt();
-    for (int i; i < N; i++) {
-        CollisionObjectData* ob_data(collision_object_data[HP.GetInt()]);
-        for (std::set<CollisionObjectData*>::iterator it = all_objects.begin();
-            it != all_objects.end(); it++) {
-            MaterialPair material_pair(std::make_pair(ob_data->material, (*it)->material));
-            if (pCL.find(material_pair) == pCL.end()) {
-                std::swap(material_pair.first, material_pair.second);
-            }
-            if (pCL.find(material_pair) != pCL.end() && ob_data->pNode != (*it)->pNode) {
-                FCL::ObjectPair object_pair(std::make_pair(ob_data->pObject, (*it)->pObject));
-                FCL::Func func(func_matrix.GetFunc(object_pair));
-                if (func) {
-                    objectpair_collision_map[object_pair] = new Collision(func,
-                        pCL[material_pair], pSF[material_pair], penetration_ratio[material_pair],
-                        ob_data, *it, &iNumRows, &iNumCols);
-                } else {
-                    std::swap(object_pair.first, object_pair.second);
-                    objectpair_collision_map[object_pair] = new Collision(func_matrix.GetFunc(object_pair),
-                        pCL[material_pair], pSF[material_pair], 1.0 - penetration_ratio[material_pair],
-                        *it, ob_data, &iNumRows, &iNumCols);
+    for (int i = 0; i < N; i++) {
+        const unsigned uObjectLabel(HP.GetInt());
+        if (collision_object_data.find(uObjectLabel) == collision_object_data.end()) {
+            silent_cerr("collision world(" << GetLabel() << "): collision object(" << uObjectLabel << ") is undefined at line " << HP.GetLineData() << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        }
+        const std::vector<CollisionObjectData*>& element_objects(collision_object_data[uObjectLabel]);
+        for (std::vector<CollisionObjectData*>::const_iterator ob_it = element_objects.begin();
+            ob_it != element_objects.end(); ob_it++) {
+            CollisionObjectData* ob_data(*ob_it);
+            if (!listed.insert(ob_data).second || paired_materials.count(ob_data->material) == 0) {
+                continue;
+            }
+            if (node_data.find(ob_data->pNode) == node_data.end()) {
+                node_data[ob_data->pNode] = new CollisionNodeData(ob_data->pNode);
+            }
+            ob_data->pNodeData = node_data[ob_data->pNode];
+            /* the broadphase callback gets back to the data of the objects it reports */
+            ob_data->pObject->setUserData(ob_data);
+            all_object_data.push_back(ob_data);
+        }
+    }
+    bool bGrid(true);
+    for (std::vector<CollisionObjectData*>::const_iterator it = all_object_data.begin();
+        it != all_object_data.end(); it++) {
+        if ((*it)->pObject->getNodeType() != fcl::GEOM_SPHERE) {
+            bGrid = false;
+        }
+    }
+    unsigned num_threads(1);
+    unsigned num_domains(0);
+    unsigned num_processes(0);
+    if (HP.IsKeyWord("broadphase")) {
+        if (HP.IsKeyWord("subdomains")) {
+            bGrid = false;
+            const integer iDomains(HP.GetInt());
+            if (iDomains < 1) {
+                silent_cerr("collision world(" << GetLabel() << "): invalid number of subdomains at line " << HP.GetLineData() << std::endl);
+                throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+            }
+            num_domains = iDomains;
+            if (HP.IsKeyWord("threads")) {
+                const integer iThreads(HP.GetInt());
+                if (iThreads < 1) {
+                    silent_cerr("collision world(" << GetLabel() << "): invalid number of threads at line " << HP.GetLineData() << std::endl);
+                    throw ErrGeneric(MBDYN_EXCEPT_ARGS);
                 }
-                objects.insert(ob_data);
-                objects.insert(*it);
+                num_threads = iThreads;
+            } else if (HP.IsKeyWord("processes")) {
+                const integer iProcesses(HP.GetInt());
+                if (iProcesses < 1) {
+                    silent_cerr("collision world(" << GetLabel() << "): invalid number of processes at line " << HP.GetLineData() << std::endl);
+                    throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+                }
+                /* a worker without a subdomain would have nothing to do */
+                num_processes = std::min(unsigned(iProcesses), num_domains);
             }
+        } else if (HP.IsKeyWord("grid")) {
+            bGrid = true;
+            if (HP.IsKeyWord("threads")) {
+                const integer iThreads(HP.GetInt());
+                if (iThreads < 1) {
+                    silent_cerr("collision world(" << GetLabel() << "): invalid number of threads at line " << HP.GetLineData() << std::endl);
+                    throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+                }
+                num_threads = iThreads;
+            }
+        } else if (HP.IsKeyWord("dynamic" "aabb" "tree")) {
+            bGrid = false;
+        } else {
+            silent_cerr("collision world(" << GetLabel() << "): a valid broadphase is expected at line " << HP.GetLineData() << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
         }
-        all_objects.insert(ob_data);
+#ifndef USE_MULTITHREAD
+        if (num_threads > 1) {
+            silent_cerr("collision world(" << GetLabel() << "): warning, built without multithread support, "
+                "the broadphase runs on one thread instead of " << num_threads << " at line " << HP.GetLineData() << std::endl);
+            num_threads = 1;
+        }
+#endif
+    }
+    pSubdomains = NULL;
+    iNumThreads = num_threads;
+    iNumProcesses = num_processes;
+    pProcesses = NULL;
+    iProcessPairs = 0;
+    iProcessPoints = 0;
+    bProcessRound = false;
+    domain_pairs.resize(std::max(num_domains, 1u));
+    if (num_domains > 0) {
+        pSubdomains = new FCL::SubdomainCollisionManager(num_domains, num_threads);
+        collision_manager = pSubdomains;
+        domain_candidates.resize(num_domains);
+    } else if (bGrid) {
+        collision_manager = new FCL::GridCollisionManager(num_threads);
+    } else {
+        collision_manager = new fcl::DynamicAABBTreeCollisionManager();
     }
-    collision_manager = new fcl::DynamicAABBTreeCollisionManager();
-    for (std::set<CollisionObjectData*>::iterator it = objects.begin();
-        it != objects.end(); it++) {
+    bActivation = false;
+    for (std::vector<CollisionObjectData*>::const_iterator it = all_object_data.begin(); it != all_object_data.end(); it++) {
         nodes.insert((*it)->pNode);
-        collision_manager->registerObject((*it)->pObject);
+        /* a node is terrain only if every one of its objects is */
+        (*it)->pNodeData->bTerrain = (*it)->pNodeData->bTerrain && (*it)->bTerrain;
+        if ((*it)->pActivation != NULL) {
+            bActivation = true;
+        }
     }
-    collision_manager->setup();
+    bSleep = false;
+    dSleepVelocity = 0.0;
+    dSleepAngularVelocity = 0.0;
+    iSleepSteps = 0;
+    if (HP.IsKeyWord("sleep")) {
+        bSleep = true;
+        dSleepVelocity = HP.GetReal();
+        dSleepAngularVelocity = HP.GetReal();
+        iSleepSteps = HP.GetInt();
+        if (dSleepVelocity < 0.0 || dSleepAngularVelocity < 0.0 || iSleepSteps < 1) {
+            silent_cerr("collision world(" << GetLabel() << "): invalid sleep thresholds at line " << HP.GetLineData() << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        }
+    }
+    if (HP.IsKeyWord("contact" "points")) {
+        const integer iMaxContacts(HP.GetInt());
+        if (iMaxContacts < 1) {
+            silent_cerr("collision world(" << GetLabel() << "): invalid number of contact points at line " << HP.GetLineData() << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        }
+        for (std::vector<CollisionMaterial*>::iterator it = materials.begin(); it != materials.end(); it++) {
+            (*it)->iMaxContacts = iMaxContacts;
+        }
+    }
+    pStream = NULL;
+    iStep = 0;
+    if (HP.IsKeyWord("stream")) {
+        const std::string name(HP.GetValue(TypedValue::VAR_STRING).GetString());
+        const integer iCapacity(HP.GetInt());
+        if (iCapacity < 1) {
+            silent_cerr("collision world(" << GetLabel() << "): invalid stream capacity at line " << HP.GetLineData() << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        }
+        try {
+            pStream = new ContactStream(name, iCapacity);
+        } catch (const std::runtime_error& e) {
+            silent_cerr("collision world(" << GetLabel() << "): " << e.what() << " at line " << HP.GetLineData() << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        }
+    }
+    this->pDM = pDM;
+    bTimeStepHint = false;
+    dMaxPenetration = 0.0;
+    dMaxPenetrationIncrement = 0.0;
+    dMinTimeStep = 0.0;
+    dMaxTimeStep = 0.0;
+    if (HP.IsKeyWord("time" "step" "hint")) {
+        bTimeStepHint = true;
+        dMaxPenetration = HP.GetReal();
+        dMaxPenetrationIncrement = HP.GetReal();
+        dMinTimeStep = HP.GetReal();
+        dMaxTimeStep = HP.GetReal();
+        if (dMaxPenetration <= 0.0 || dMaxPenetrationIncrement <= 0.0 || dMinTimeStep <= 0.0 || dMaxTimeStep < dMinTimeStep) {
+            silent_cerr("collision world(" << GetLabel() << "): invalid time step hint parameters at line " << HP.GetLineData() << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        }
+    }
+    dJacobianTolerance = -1.0;
+    if (HP.IsKeyWord("frozen" "jacobian")) {
+        dJacobianTolerance = HP.GetReal();
+        if (dJacobianTolerance < 0.0) {
+            silent_cerr("collision world(" << GetLabel() << "): invalid frozen jacobian tolerance at line " << HP.GetLineData() << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        }
+    }
+    bAsyncBroadphase = false;
+    dAsyncInflation = 0.0;
+    if (HP.IsKeyWord("async" "broadphase")) {
+        bAsyncBroadphase = true;
+        if (HP.IsArg()) {
+            dAsyncInflation = HP.GetReal();
+            if (dAsyncInflation < 0.0) {
+                silent_cerr("collision world(" << GetLabel() << "): invalid async broadphase inflation at line " << HP.GetLineData() << std::endl);
+                throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+            }
+        }
+    }
+    if (bAsyncBroadphase && iNumProcesses > 0) {
+        silent_cerr("collision world(" << GetLabel() << "): async broadphase cannot be used with processes at line " << HP.GetLineData() << std::endl);
+        throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+    }
+    bActiveRegion = false;
+    if (HP.IsKeyWord("active" "region")) {
+        bActiveRegion = true;
+        bActivation = true;
+        const Vec3 vMin(HP.GetVec3());
+        const Vec3 vMax(HP.GetVec3());
+        if (!(vMin(1) < vMax(1) && vMin(2) < vMax(2) && vMin(3) < vMax(3))) {
+            silent_cerr("collision world(" << GetLabel() << "): invalid active region at line " << HP.GetLineData() << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        }
+        active_region = fcl::AABB(fcl::Vec3f(vMin(1), vMin(2), vMin(3)), fcl::Vec3f(vMax(1), vMax(2), vMax(3)));
+    }
+    dAsyncTime = pDM->dGetTime();
+    dAsyncStep = 0.0;
+    bAsyncRunning = false;
+    bAsyncReady = false;
+    dStepStart = dGetWallTime();
+    dStepWallTime = 0.0;
+    dCollisionTime = 0.0;
+    dStepCollisionTime = 0.0;
+    dLastTime = pDM->dGetTime();
+    dTimeStepHint = dMaxTimeStep;
+    dPenetration = 0.0;
+    dApproachVelocity = 0.0;
+    bNewContacts = false;
+    UpdateActivation();
     SetOutputFlag(pDM->fReadOutput(HP, Elem::LOADABLE));
 }
 
 CollisionWorld::~CollisionWorld(void)
 {
+    JoinBroadphase();
+    delete pProcesses;
     delete collision_manager;
+    delete pStream;
+    delete pWorkVec;
+    delete pWorkMat;
+    for (std::vector<PairMap>::iterator d = domain_pairs.begin(); d != domain_pairs.end(); d++) {
+        for (PairMap::iterator it = d->begin(); it != d->end(); it++) {
+            delete it->second;
+        }
+    }
+    for (std::vector<CollisionBlock*>::iterator it = blocks.begin(); it != blocks.end(); it++) {
+        delete *it;
+    }
+    for (std::vector<CollisionMaterial*>::iterator it = materials.begin(); it != materials.end(); it++) {
+        delete *it;
+    }
+    for (std::map<const StructNode*, CollisionNodeData*>::iterator it = node_data.begin();
+        it != node_data.end(); it++) {
+        delete it->second;
+    }
+}
+
+bool
+CollisionWorld::CollisionFunction(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* cdata_)
+{
+    static_cast<CollisionWorld*>(cdata_)->AddCandidate(o1, o2);
+    return false;
+}
+
+CollisionWorld::PairMap::iterator
+CollisionWorld::FindPair(PairMap& pair_map, fcl::CollisionObject* o1, fcl::CollisionObject* o2)
+{
+    PairMap::iterator it(pair_map.find(FCL::ObjectPair(o1, o2)));
+    if (it == pair_map.end()) {
+        it = pair_map.find(FCL::ObjectPair(o2, o1));
+    }
+    return it;
+}
+
+void
+CollisionWorld::AddCandidate(fcl::CollisionObject* o1, fcl::CollisionObject* o2)
+{
+    const unsigned d(pSubdomains != NULL ? pSubdomains->Domain(o1, o2) : 0);
+    PairMap& pair_map(domain_pairs[d]);
+    PairMap::iterator it(FindPair(pair_map, o1, o2));
+    if (it != pair_map.end()) {
+        candidates.push_back(it->second);
+        return;
+    }
+    /* a pair moves with the lower bound of its overlap, look in the other subdomains */
+    for (unsigned e = 0; e < domain_pairs.size(); e++) {
+        if (e == d) {
+            continue;
+        }
+        it = FindPair(domain_pairs[e], o1, o2);
+        if (it != domain_pairs[e].end()) {
+            pair_map.insert(*it);
+            candidates.push_back(it->second);
+            domain_pairs[e].erase(it);
+            return;
+        }
+    }
+    CollisionObjectData* pD1(static_cast<CollisionObjectData*>(o1->getUserData()));
+    CollisionObjectData* pD2(static_cast<CollisionObjectData*>(o2->getUserData()));
+    if (IsPairable(pD1, pD2)) {
+        candidates.push_back(AddPair(pair_map, pD1, pD2));
+    }
+}
+
+void
+CollisionWorld::UpdateIslands(void)
+{
+    for (std::map<const StructNode*, CollisionNodeData*>::iterator it = node_data.begin();
+        it != node_data.end(); it++) {
+        CollisionNodeData* pND(it->second);
+        if (pND->pNode->GetVCurr().Norm() < dSleepVelocity
+            && pND->pNode->GetWCurr().Norm() < dSleepAngularVelocity) {
+            pND->iQuietSteps++;
+        } else {
+            pND->iQuietSteps = 0;
+        }
+        pND->pIsland = pND;
+        pND->bIslandQuiet = true;
+    }
+
+    /* islands are the connected components of touching pairs; terrain does not connect them */
+    for (std::vector<PairMap>::const_iterator d = domain_pairs.begin(); d != domain_pairs.end(); d++) {
+        for (PairMap::const_iterator it = d->begin(); it != d->end(); it++) {
+            CollisionNodeData* pND1(it->second->pGetNodeData1());
+            CollisionNodeData* pND2(it->second->pGetNodeData2());
+            if (it->second->HasContacts() && !pND1->bTerrain && !pND2->bTerrain) {
+                pND1->Union(pND2);
+            }
+        }
+    }
+    for (std::map<const StructNode*, CollisionNodeData*>::iterator it = node_data.begin();
+        it != node_data.end(); it++) {
+        if (!it->second->bTerrain && it->second->iQuietSteps < iSleepSteps) {
+            it->second->Find()->bIslandQuiet = false;
+        }
+    }
+    for (std::map<const StructNode*, CollisionNodeData*>::iterator it = node_data.begin();
+        it != node_data.end(); it++) {
+        CollisionNodeData* pND(it->second);
+        if (pND->bTerrain) {
+            pND->bSleeping = (pND->iQuietSteps >= iSleepSteps);
+        } else {
+            pND->bSleeping = pND->Find()->bIslandQuiet;
+        }
+    }
+    for (std::vector<CollisionBlock*>::const_iterator it = blocks.begin(); it != blocks.end(); it++) {
+        (*it)->SetSleeping((*it)->pGetNodeData1()->bSleeping && (*it)->pGetNodeData2()->bSleeping);
+    }
+}
+
+void
+CollisionWorld::Broadphase(void)
+{
+    bProcessRound = (iNumProcesses > 0 && BroadphaseProcesses());
+    if (bProcessRound) {
+        return;
+    }
+    if (bSleep) {
+        awake_objects.clear();
+        for (std::vector<CollisionObjectData*>::const_iterator it = object_data.begin(); it != object_data.end(); it++) {
+            if (!(*it)->pNodeData->bSleeping) {
+                awake_objects.push_back((*it)->pObject);
+            }
+        }
+        collision_manager->update(awake_objects);
+    } else {
+        collision_manager->update();
+    }
+    collision_manager->collide(this, CollisionFunction);
+}
+
+bool
+CollisionWorld::WakeIslands(void)
+{
+    std::set<CollisionNodeData*> islands;
+    for (std::vector<Collision*>::const_iterator it = candidates.begin(); it != candidates.end(); it++) {
+        CollisionNodeData* pND1((*it)->pGetNodeData1());
+        CollisionNodeData* pND2((*it)->pGetNodeData2());
+        if (pND1->bSleeping == pND2->bSleeping) {
+            continue;
+        }
+        if (pND1->bSleeping) {
+            std::swap(pND1, pND2);
+        }
+        /* pND1 is awake: wake pND2's island only if pND1 is actually moving */
+        if (pND1->iQuietSteps == 0 && !pND2->bTerrain) {
+            islands.insert(pND2->Find());
+        }
+    }
+    if (islands.empty()) {
+        return false;
+    }
+    for (std::map<const StructNode*, CollisionNodeData*>::iterator it = node_data.begin();
+        it != node_data.end(); it++) {
+        CollisionNodeData* pND(it->second);
+        if (pND->bSleeping && !pND->bTerrain && islands.count(pND->Find()) > 0) {
+            pND->bSleeping = false;
+            pND->iQuietSteps = 0;
+        }
+    }
+    for (std::vector<CollisionObjectData*>::iterator it = object_data.begin(); it != object_data.end(); it++) {
+        if (!(*it)->pNodeData->bSleeping && islands.count((*it)->pNodeData->Find()) > 0) {
+            /* refit was skipped while asleep */
+            (*it)->UpdateTransform();
+        }
+    }
+    for (std::vector<CollisionBlock*>::const_iterator it = blocks.begin(); it != blocks.end(); it++) {
+        if ((*it)->IsSleeping() && !((*it)->pGetNodeData1()->bSleeping && (*it)->pGetNodeData2()->bSleeping)) {
+            (*it)->SetSleeping(false);
+            (*it)->ClearContacts();
+        }
+    }
+    return true;
+}
+
+bool
+CollisionWorld::IsPairable(const CollisionObjectData* pD1, const CollisionObjectData* pD2) const
+{
+    if (pD1->pNode == pD2->pNode) {
+        return false;
+    }
+    if (material_pairs.find(MaterialPair(pD1->material, pD2->material)) == material_pairs.end()
+        && material_pairs.find(MaterialPair(pD2->material, pD1->material)) == material_pairs.end()) {
+        return false;
+    }
+    return func_matrix.GetFunc(std::make_pair(pD1->pObject, pD2->pObject))
+        || func_matrix.GetFunc(std::make_pair(pD2->pObject, pD1->pObject));
+}
+
+Collision*
+CollisionWorld::AddPair(PairMap& pair_map, CollisionObjectData* pD1, CollisionObjectData* pD2)
+{
+    MaterialPair material_pair(pD1->material, pD2->material);
+    if (material_pairs.find(material_pair) == material_pairs.end()) {
+        std::swap(material_pair.first, material_pair.second);
+    }
+    CollisionMaterial* pMaterial(material_pairs[material_pair]);
+    FCL::ObjectPair object_pair(std::make_pair(pD1->pObject, pD2->pObject));
+    FCL::Func func(func_matrix.GetFunc(object_pair));
+    Collision* pCollision;
+    if (func) {
+        pCollision = new Collision(func, pMaterial, false, pD1, pD2, &contacts);
+    } else {
+        std::swap(object_pair.first, object_pair.second);
+        pCollision = new Collision(func_matrix.GetFunc(object_pair), pMaterial, true, pD2, pD1, &contacts);
+    }
+    pair_map[object_pair] = pCollision;
+    const NodePair node_pair(std::min(pD1->pNode, pD2->pNode), std::max(pD1->pNode, pD2->pNode));
+    std::map<NodePair, CollisionBlock*>::iterator it(node_pair_block.find(node_pair));
+    if (it == node_pair_block.end()) {
+        CollisionBlock* pBlock(new CollisionBlock(pD1->pNode, pD2->pNode));
+        pBlock->SetJacobianTolerance(dJacobianTolerance);
+        blocks.push_back(pBlock);
+        it = node_pair_block.insert(std::make_pair(node_pair, pBlock)).first;
+    }
+    it->second->Add(pCollision);
+    return pCollision;
+}
+
+void
+CollisionWorld::RemovePair(Collision* pCollision)
+{
+    const StructNode* pNode1(pCollision->pGetNodeData1()->pNode);
+    const StructNode* pNode2(pCollision->pGetNodeData2()->pNode);
+    std::map<NodePair, CollisionBlock*>::iterator it(node_pair_block.find(NodePair(std::min(pNode1, pNode2), std::max(pNode1, pNode2))));
+    /* the block is released, if emptied, by ReleaseEmptyBlocks() */
+    it->second->Remove(pCollision);
+    delete pCollision;
+}
+
+static bool
+IsBlockInUse(const CollisionBlock* pBlock)
+{
+    return !pBlock->IsEmpty();
+}
+
+void
+CollisionWorld::ReleaseEmptyBlocks(void)
+{
+    for (std::map<NodePair, CollisionBlock*>::iterator it = node_pair_block.begin(); it != node_pair_block.end();) {
+        if (it->second->IsEmpty()) {
+            node_pair_block.erase(it++);
+        } else {
+            it++;
+        }
+    }
+    std::vector<CollisionBlock*>::iterator end(std::stable_partition(blocks.begin(), blocks.end(), IsBlockInUse));
+    for (std::vector<CollisionBlock*>::iterator it = end; it != blocks.end(); it++) {
+        delete *it;
+    }
+    blocks.erase(end, blocks.end());
+}
+
+void
+CollisionWorld::ReleasePairs(void)
+{
+    /* a pair the last broadphase did not report has no contacts; it is made again when it is */
+    std::set<const Collision*> hit(candidates.begin(), candidates.end());
+    bool bReleased(false);
+    for (std::vector<PairMap>::iterator d = domain_pairs.begin(); d != domain_pairs.end(); d++) {
+        for (PairMap::iterator it = d->begin(); it != d->end();) {
+            if (!it->second->IsSleeping() && hit.count(it->second) == 0) {
+                RemovePair(it->second);
+                d->erase(it++);
+                bReleased = true;
+            } else {
+                it++;
+            }
+        }
+    }
+    if (bReleased) {
+        ReleaseEmptyBlocks();
+        GatherContacts(true);
+    }
+}
+
+void
+CollisionWorld::ResizeWorkSpace(void)
+{
+    const integer iRows(CollisionBlock::iBlockSize * blocks.size());
+    if (iRows <= iWorkRows) {
+        return;
+    }
+    /* grown geometrically, as blocks come and go with the contacts */
+    iWorkRows = std::max(iRows, 2 * iWorkRows);
+    delete pWorkVec;
+    delete pWorkMat;
+    pWorkVec = new MySubVectorHandler(iWorkRows);
+    pWorkMat = new VariableSubMatrixHandler(CollisionBlock::iBlockSize, CollisionBlock::iBlockSize,
+        iWorkRows * CollisionBlock::iBlockSize);
+}
+
+void
+CollisionWorld::GatherContacts(bool bKeep)
+{
+    gathered.Clear();
+    pairs.clear();
+    for (std::vector<CollisionBlock*>::const_iterator it = blocks.begin(); it != blocks.end(); it++) {
+        (*it)->Gather(gathered, pairs, bKeep);
+    }
+    /* the pairs point to contacts, whose content is what is swapped */
+    contacts.Swap(gathered);
+}
+
+static bool
+IsInactive(const CollisionObjectData* pD)
+{
+    return !pD->bActive;
+}
+
+void
+CollisionWorld::UpdateActivation(void)
+{
+    /* the async broadphase reads the active objects */
+    JoinBroadphase();
+    std::vector<CollisionObjectData*> activated;
+    std::set<fcl::CollisionObject*> deactivated;
+    for (std::vector<CollisionObjectData*>::const_iterator it = all_object_data.begin(); it != all_object_data.end(); it++) {
+        CollisionObjectData* pD(*it);
+        bool bActive(pD->pActivation == NULL || pD->pActivation->dGet() != 0.0);
+        if (bActive && bActiveRegion) {
+            if (!pD->bActive) {
+                /* its element skips the refit while it is off */
+                pD->UpdateTransform();
+            }
+            bActive = active_region.overlap(pD->pObject->getAABB());
+        }
+        if (bActive == pD->bActive) {
+            continue;
+        }
+        pD->bActive = bActive;
+        if (bActive) {
+            activated.push_back(pD);
+        } else {
+            collision_manager->unregisterObject(pD->pObject);
+            deactivated.insert(pD->pObject);
+        }
+    }
+    if (pProcesses != NULL && !(activated.empty() && deactivated.empty())) {
+        /* the workers know the objects that were active when they were forked */
+        delete pProcesses;
+        pProcesses = NULL;
+    }
+    if (!deactivated.empty()) {
+        for (std::vector<PairMap>::iterator d = domain_pairs.begin(); d != domain_pairs.end(); d++) {
+            for (PairMap::iterator it = d->begin(); it != d->end();) {
+                if (deactivated.count(it->first.first) > 0 || deactivated.count(it->first.second) > 0) {
+                    RemovePair(it->second);
+                    d->erase(it++);
+                } else {
+                    it++;
+                }
+            }
+        }
+        ReleaseEmptyBlocks();
+        object_data.erase(std::remove_if(object_data.begin(), object_data.end(), IsInactive), object_data.end());
+        /* drop the contacts of the deleted pairs */
+        GatherContacts(true);
+    }
+    if (activated.empty()) {
+        return;
+    }
+    std::vector<fcl::CollisionObject*> fcl_objects;
+    for (std::vector<CollisionObjectData*>::const_iterator it = activated.begin(); it != activated.end(); it++) {
+        (*it)->UpdateTransform();
+        object_data.push_back(*it);
+        fcl_objects.push_back((*it)->pObject);
+    }
+    collision_manager->registerObjects(fcl_objects);
+    collision_manager->setup();
 }
 
 void
 CollisionWorld::WorkSpaceDim(integer* piNumRows, integer* piNumCols) const
 {
-    *piNumRows = iNumRows;
-    *piNumCols = iNumCols;
+    /*
+     * AssRes and AssJac fill and return pWorkVec and pWorkMat, grown with the
+     * blocks in use, and the data manager assembles the handler returned; the
+     * work buffers it sizes from this bound are never filled by this element.
+     * One block keeps the bound fixed and nonzero for whoever reads it once.
+     */
+    *piNumRows = CollisionBlock::iBlockSize;
+    *piNumCols = CollisionBlock::iBlockSize;
 }
 
 int
@@ -540,28 +1981,461 @@ CollisionWorld::SetValue(DataManager *pDM,
     VectorHandler& X, VectorHandler& XP,
     SimulationEntity::Hints *ph)
 {
-    NO_OP;
+    dLastTime = pDM->dGetTime();
+}
+
+void
+CollisionWorld::AfterPredict(VectorHandler& X, VectorHandler& XP)
+{
+    const doublereal dStart(dGetWallTime());
+    if (bAsyncBroadphase) {
+        JoinBroadphase();
+    }
+    for (std::vector<Collision*>::const_iterator it = pairs.begin(); it != pairs.end(); it++) {
+        (*it)->ClearAndSetTangents();
+    }
+    dCollisionTime += dGetWallTime() - dStart;
+}
+
+void
+CollisionWorld::AfterConvergence(const VectorHandler& X, const VectorHandler& XP)
+{
+    const doublereal dStart(dGetWallTime());
+    ss.str("");
+    ss.clear();
+    for (std::size_t i = 0; i < contacts.Size(); i++) {
+        pairs[contacts.pair[i]]->OutputAppend(ss, i);
+    }
+    for (std::vector<Collision*>::const_iterator it = pairs.begin(); it != pairs.end(); it++) {
+        if (pStream != NULL) {
+            (*it)->StreamAppend(records);
+        }
+        (*it)->CommitStick();
+        (*it)->ClearAndSetTangents();
+    }
+    if (bTimeStepHint) {
+        UpdateTimeStepHint();
+    }
+    if (bSleep) {
+        UpdateIslands();
+    }
+    ReleasePairs();
+    if (pStream != NULL) {
+        iStep++;
+        const doublereal dTime(pDM->dGetTime());
+        for (std::size_t i = 0; i < records.size(); i++) {
+            records[i].step = iStep;
+            records[i].time = dTime;
+            records[i].index = i;
+            records[i].count = records.size();
+            pStream->Publish(records[i]);
+        }
+        pStream->EndStep(iStep);
+        records.clear();
+    }
+    if (bActivation) {
+        UpdateActivation();
+    }
+    if (bAsyncBroadphase) {
+        PredictBroadphase();
+    }
+    const doublereal dEnd(dGetWallTime());
+    dStepCollisionTime = dCollisionTime + dEnd - dStart;
+    dCollisionTime = 0.0;
+    dStepWallTime = dEnd - dStepStart;
+    dStepStart = dEnd;
+}
+
+void
+CollisionWorld::PredictBroadphase(void)
+{
+    /* a worker may still be running if the previous prediction was never used */
+    JoinBroadphase();
+
+    /* the next step is taken as long as the last one, or as hinted */
+    const doublereal dTime(pDM->dGetTime());
+    dAsyncStep = bTimeStepHint ? dTimeStepHint : dTime - dAsyncTime;
+    dAsyncTime = dTime;
+    bAsyncReady = false;
+    if (!(dAsyncStep > 0.0)) {
+        return;
+    }
+    swept.resize(object_data.size());
+    for (std::size_t i = 0; i < object_data.size(); i++) {
+        const CollisionObjectData* pD(object_data[i]);
+        const fcl::AABB& aabb(pD->pObject->getAABB());
+        const fcl::FCL_REAL diagonal((aabb.max_ - aabb.min_).length());
+        swept[i] = aabb;
+        if (!(diagonal < std::numeric_limits<fcl::FCL_REAL>::max())) {
+            /* unbounded, such as planes */
+            continue;
+        }
+        const fcl::Vec3f c(aabb.center());
+        const Vec3 Arm(Vec3(c[0], c[1], c[2]) - pD->pNode->GetXCurr());
+        const Vec3 d((pD->pNode->GetVCurr() + pD->pNode->GetWCurr().Cross(Arm)) * dAsyncStep);
+        /* a rotation by |W| dt moves no point of the box farther than |W| dt times its half diagonal */
+        const doublereal r(pD->pNode->GetWCurr().Norm() * dAsyncStep * 0.5 * diagonal + dAsyncInflation);
+        swept[i] += fcl::AABB(aabb.min_ + fcl::Vec3f(d(1), d(2), d(3)), aabb.max_ + fcl::Vec3f(d(1), d(2), d(3)));
+        swept[i].expand(fcl::Vec3f(r, r, r));
+    }
+#ifdef USE_MULTITHREAD
+    if (pthread_create(&async_thread, NULL, BroadphaseThread, this) == 0) {
+        bAsyncRunning = true;
+        return;
+    }
+    /* could not spawn, build the list here */
+#endif
+    BuildCandidates();
+}
+
+void*
+CollisionWorld::BroadphaseThread(void* arg)
+{
+    static_cast<CollisionWorld*>(arg)->BuildCandidates();
+    return NULL;
+}
+
+void
+CollisionWorld::BuildCandidates(void)
+{
+    /* sweep and prune along x over the swept bounds; only reads swept and the active objects */
+    const std::size_t N(swept.size());
+    std::vector<std::pair<fcl::FCL_REAL, std::size_t> > order(N);
+    for (std::size_t i = 0; i < N; i++) {
+        order[i] = std::make_pair(swept[i].min_[0], i);
+    }
+    std::sort(order.begin(), order.end());
+    async_candidates.clear();
+    for (std::size_t a = 0; a < N; a++) {
+        const std::size_t i(order[a].second);
+        for (std::size_t b = a + 1; b < N && order[b].first <= swept[i].max_[0]; b++) {
+            const std::size_t j(order[b].second);
+            if (!swept[i].overlap(swept[j])) {
+                continue;
+            }
+            async_candidates.push_back(std::make_pair(object_data[i]->pObject, object_data[j]->pObject));
+        }
+    }
+    bAsyncReady = true;
+}
+
+void
+CollisionWorld::JoinBroadphase(void)
+{
+#ifdef USE_MULTITHREAD
+    if (bAsyncRunning) {
+        pthread_join(async_thread, NULL);
+        bAsyncRunning = false;
+    }
+#endif
+}
+
+bool
+CollisionWorld::UseAsyncCandidates(void)
+{
+    if (!bAsyncReady) {
+        return false;
+    }
+    for (std::size_t i = 0; i < object_data.size(); i++) {
+        if (!swept[i].contain(object_data[i]->pObject->getAABB())) {
+            /* outside its prediction, the list may miss pairs until the next step */
+            bAsyncReady = false;
+            return false;
+        }
+    }
+    for (std::vector<FCL::ObjectPair>::const_iterator it = async_candidates.begin(); it != async_candidates.end(); it++) {
+        if (it->first->getAABB().overlap(it->second->getAABB())) {
+            AddCandidate(it->first, it->second);
+        }
+    }
+    return true;
+}
+
+std::size_t
+CollisionWorld::iGetMemory(void) const
+{
+    /* bytes held by pairs, the contact buffers, blocks, the assembly handlers and the shared materials */
+    std::size_t iMemory(materials.size() * sizeof(CollisionMaterial)
+        + contacts.iGetMemory() + gathered.iGetMemory()
+        + iWorkRows * (1 + CollisionBlock::iBlockSize) * (sizeof(doublereal) + 2 * sizeof(integer)));
+    for (std::vector<PairMap>::const_iterator d = domain_pairs.begin(); d != domain_pairs.end(); d++) {
+        for (PairMap::const_iterator it = d->begin(); it != d->end(); it++) {
+            iMemory += it->second->iGetMemory();
+        }
+    }
+    for (std::vector<CollisionBlock*>::const_iterator it = blocks.begin(); it != blocks.end(); it++) {
+        iMemory += (*it)->iGetMemory();
+    }
+    return iMemory;
+}
+
+void
+CollisionWorld::UpdateTimeStepHint(void)
+{
+    dPenetration = 0.0;
+    dApproachVelocity = 0.0;
+    bNewContacts = false;
+    for (std::vector<PairMap>::const_iterator d = domain_pairs.begin(); d != domain_pairs.end(); d++) {
+        for (PairMap::const_iterator it = d->begin(); it != d->end(); it++) {
+            if (it->second->UpdateContactState(dPenetration, dApproachVelocity)) {
+                bNewContacts = true;
+            }
+        }
+    }
+    const doublereal dTime(pDM->dGetTime());
+    const doublereal dt(dTime - dLastTime);
+    dLastTime = dTime;
+    if (!(dt > 0.0)) {
+        return;
+    }
+
+    /* the next step should close at most the allowed increment, and shrink when too deep */
+    doublereal dHint(std::min(dMaxTimeStep, 2.0 * dt));
+    if (dApproachVelocity > 0.0) {
+        dHint = std::min(dHint, dMaxPenetrationIncrement / dApproachVelocity);
+    }
+    if (dPenetration > dMaxPenetration) {
+        dHint = std::min(dHint, dt * dMaxPenetration / dPenetration);
+    }
+    if (bNewContacts) {
+        dHint = std::min(dHint, dt);
+    }
+    dTimeStepHint = std::max(dHint, dMinTimeStep);
+}
+
+void*
+CollisionWorld::IntersectThread(void* arg)
+{
+    IntersectData* pData(static_cast<IntersectData*>(arg));
+    for (std::size_t d = pData->first; d < pData->pCandidates->size(); d += pData->stride) {
+        const std::vector<Collision*>& domain((*pData->pCandidates)[d]);
+        for (std::vector<Collision*>::const_iterator it = domain.begin(); it != domain.end(); it++) {
+            (*it)->Intersect();
+        }
+    }
+    return NULL;
+}
+
+void
+CollisionWorld::IntersectSubdomains(void)
+{
+    /* each pair only writes its own contacts, so subdomains run concurrently */
+    std::vector<Collision*> shared;
+    for (std::vector<std::vector<Collision*> >::iterator it = domain_candidates.begin(); it != domain_candidates.end(); it++) {
+        it->clear();
+    }
+    for (std::vector<Collision*>::const_iterator it = candidates.begin(); it != candidates.end(); it++) {
+        if ((*it)->IsSleeping()) {
+            continue;
+        }
+        if ((*it)->IsThreadSafe()) {
+            domain_candidates[pSubdomains->Domain((*it)->pGetObject1(), (*it)->pGetObject2())].push_back(*it);
+        } else {
+            shared.push_back(*it);
+        }
+    }
+    const unsigned num_workers(std::min(iNumThreads, unsigned(domain_candidates.size())));
+#ifdef USE_MULTITHREAD
+    if (num_workers > 1) {
+        std::vector<pthread_t> threads(num_workers);
+        std::vector<IntersectData> data(num_workers);
+        for (unsigned t = 0; t < num_workers; t++) {
+            data[t].pCandidates = &domain_candidates;
+            data[t].first = t;
+            data[t].stride = num_workers;
+        }
+        for (unsigned t = 1; t < num_workers; t++) {
+            if (pthread_create(&threads[t], NULL, IntersectThread, &data[t]) != 0) {
+                /* could not spawn, do these subdomains here */
+                IntersectThread(&data[t]);
+                threads[t] = pthread_self();
+            }
+        }
+        IntersectThread(&data[0]);
+        for (unsigned t = 1; t < num_workers; t++) {
+            if (!pthread_equal(threads[t], pthread_self())) {
+                pthread_join(threads[t], NULL);
+            }
+        }
+    } else
+#endif
+    {
+        IntersectData data;
+        data.pCandidates = &domain_candidates;
+        data.first = 0;
+        data.stride = 1;
+        IntersectThread(&data);
+    }
+    for (std::vector<Collision*>::const_iterator it = shared.begin(); it != shared.end(); it++) {
+        (*it)->Intersect();
+    }
+}
+
+void
+CollisionWorld::SpawnProcesses(void)
+{
+    process_index.clear();
+    for (std::size_t i = 0; i < object_data.size(); i++) {
+        process_index[object_data[i]->pObject] = i;
+    }
+    if (iProcessPairs == 0) {
+        iProcessPairs = 8 * object_data.size() / iNumProcesses + 64;
+    }
+    std::size_t iMaxContacts(1);
+    for (std::vector<CollisionMaterial*>::const_iterator it = materials.begin(); it != materials.end(); it++) {
+        iMaxContacts = std::max(iMaxContacts, (*it)->iMaxContacts);
+    }
+    iProcessPoints = iMaxContacts * iProcessPairs;
+    const std::size_t common_size(sizeof(ProcessRound)
+        + (pSubdomains->GetNumDomains() - 1 + 12 * object_data.size()) * sizeof(fcl::FCL_REAL));
+    const std::size_t worker_size(sizeof(ProcessResults) + iProcessPairs * sizeof(ProcessPair)
+        + 6 * iProcessPoints * sizeof(fcl::FCL_REAL));
+    try {
+        pProcesses = new WorkerProcesses(iNumProcesses, common_size, worker_size, ProcessWork, this);
+    } catch (const std::runtime_error& e) {
+        silent_cerr("collision world(" << GetLabel() << "): " << e.what() << std::endl);
+        throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+    }
+}
+
+bool
+CollisionWorld::BroadphaseProcesses(void)
+{
+    if (pProcesses == NULL) {
+        SpawnProcesses();
+    }
+    /* the solver cuts the slabs, so that every worker agrees on who owns a pair */
+    pSubdomains->Repartition();
+    ProcessRound* pRound(static_cast<ProcessRound*>(pProcesses->pGetCommon()));
+    pRound->axis = pSubdomains->GetAxis();
+    pRound->num_objects = object_data.size();
+    fcl::FCL_REAL* p(reinterpret_cast<fcl::FCL_REAL*>(pRound + 1));
+    p = std::copy(pSubdomains->GetBoundaries().begin(), pSubdomains->GetBoundaries().end(), p);
+    for (std::vector<CollisionObjectData*>::const_iterator it = object_data.begin(); it != object_data.end(); it++) {
+        const fcl::Transform3f& tf((*it)->pObject->getTransform());
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                *p++ = tf.getRotation()(i, j);
+            }
+        }
+        for (int i = 0; i < 3; i++) {
+            *p++ = tf.getTranslation()[i];
+        }
+    }
+    try {
+        pProcesses->Run();
+    } catch (const std::runtime_error& e) {
+        silent_cerr("collision world(" << GetLabel() << "): " << e.what() << std::endl);
+        throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+    }
+    for (unsigned w = 0; w < pProcesses->GetNumWorkers(); w++) {
+        if (static_cast<const ProcessResults*>(pProcesses->pGetWorker(w))->overflow) {
+            /* this round runs here, the next one on workers with twice the room */
+            iProcessPairs *= 2;
+            delete pProcesses;
+            pProcesses = NULL;
+            return false;
+        }
+    }
+    process_hits.clear();
+    for (unsigned w = 0; w < pProcesses->GetNumWorkers(); w++) {
+        const ProcessResults* pResults(static_cast<const ProcessResults*>(pProcesses->pGetWorker(w)));
+        const ProcessPair* pPairs(reinterpret_cast<const ProcessPair*>(pResults + 1));
+        const fcl::FCL_REAL* pPoints(reinterpret_cast<const fcl::FCL_REAL*>(pPairs + iProcessPairs));
+        for (uint32_t k = 0; k < pResults->num_pairs; k++) {
+            const std::size_t n(candidates.size());
+            AddCandidate(object_data[pPairs[k].object1]->pObject, object_data[pPairs[k].object2]->pObject);
+            if (candidates.size() > n) {
+                process_hits.push_back(std::make_pair(pPairs + k, pPoints));
+            }
+        }
+    }
+    return true;
+}
+
+void
+CollisionWorld::ApplyProcessContacts(void)
+{
+    for (std::size_t k = 0; k < candidates.size(); k++) {
+        Collision* pCollision(candidates[k]);
+        const ProcessPair* pPair(process_hits[k].first);
+        if (pCollision->IsSleeping()) {
+            continue;
+        }
+        if (pCollision->pGetObject1() == object_data[pPair->object1]->pObject) {
+            pCollision->SetFound(process_hits[k].second + 6 * pPair->first, pPair->count);
+        } else {
+            /* made here the other way round by an earlier round on the solver */
+            pCollision->Intersect();
+        }
+    }
 }
 
 void
-CollisionWorld::AfterPredict(VectorHandler& X, VectorHandler& XP)
+CollisionWorld::ProcessWork(unsigned worker, void* arg, const void* common, void* results)
 {
-    for (std::map<FCL::ObjectPair, Collision*>::const_iterator it = objectpair_collision_map.begin();
-        it != objectpair_collision_map.end(); it++) {
-        it->second->ClearAndSetTangents();
-    }
+    static_cast<CollisionWorld*>(arg)->WorkProcess(worker, common, results);
 }
 
 void
-CollisionWorld::AfterConvergence(const VectorHandler& X, const VectorHandler& XP)
+CollisionWorld::WorkProcess(unsigned worker, const void* common, void* results)
 {
-    ss.str("");
-    ss.clear();
-    for (std::map<FCL::ObjectPair, Collision*>::const_iterator it = objectpair_collision_map.begin();
-        it != objectpair_collision_map.end(); it++) {
-        it->second->OutputAppend(ss);
-        it->second->ClearAndSetTangents();
+    /* runs in a worker, on its own copy of the world; its pairs are those of its subdomains */
+    const ProcessRound* pRound(static_cast<const ProcessRound*>(common));
+    const fcl::FCL_REAL* pBoundaries(reinterpret_cast<const fcl::FCL_REAL*>(pRound + 1));
+    const fcl::FCL_REAL* p(pBoundaries + pSubdomains->GetNumDomains() - 1);
+    pSubdomains->SetPartition(pRound->axis, pBoundaries);
+    for (std::vector<CollisionObjectData*>::const_iterator it = object_data.begin(); it != object_data.end(); it++, p += 12) {
+        fcl::CollisionObject* pObject((*it)->pObject);
+        if (pObject->getNodeType() != fcl::GEOM_PLANE) {
+            pObject->setTransform(fcl::Matrix3f(p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8]),
+                fcl::Vec3f(p[9], p[10], p[11]));
+            pObject->computeAABB();
+        }
+    }
+    candidates.clear();
+    for (unsigned d = worker; d < pSubdomains->GetNumDomains(); d += iNumProcesses) {
+        pSubdomains->CollideDomain(d, this, CollisionFunction);
+    }
+    ProcessResults* pResults(static_cast<ProcessResults*>(results));
+    ProcessPair* pPairs(reinterpret_cast<ProcessPair*>(pResults + 1));
+    fcl::FCL_REAL* pPoints(reinterpret_cast<fcl::FCL_REAL*>(pPairs + iProcessPairs));
+    pResults->num_pairs = 0;
+    pResults->num_points = 0;
+    pResults->overflow = 0;
+    for (std::vector<Collision*>::const_iterator it = candidates.begin(); it != candidates.end(); it++) {
+        (*it)->Intersect();
+        const FCL::Vec3f_pairs& found((*it)->GetFound());
+        if (pResults->num_pairs == iProcessPairs || pResults->num_points + found.size() > iProcessPoints) {
+            pResults->overflow = 1;
+            break;
+        }
+        ProcessPair& pair(pPairs[pResults->num_pairs++]);
+        pair.object1 = process_index[(*it)->pGetObject1()];
+        pair.object2 = process_index[(*it)->pGetObject2()];
+        pair.first = pResults->num_points;
+        pair.count = found.size();
+        for (FCL::Vec3f_pairs::const_iterator f = found.begin(); f != found.end(); f++) {
+            fcl::FCL_REAL* q(pPoints + 6 * pResults->num_points++);
+            for (int i = 0; i < 3; i++) {
+                q[i] = f->first[i];
+                q[3 + i] = f->second[i];
+            }
+        }
     }
+    /* drop the pairs this worker no longer sees, also those now owned by another worker */
+    std::set<const Collision*> hit(candidates.begin(), candidates.end());
+    for (std::vector<PairMap>::iterator d = domain_pairs.begin(); d != domain_pairs.end(); d++) {
+        for (PairMap::iterator it = d->begin(); it != d->end();) {
+            if (hit.count(it->second) == 0) {
+                RemovePair(it->second);
+                d->erase(it++);
+            } else {
+                it++;
+            }
+        }
+    }
+    ReleaseEmptyBlocks();
 }
 
 SubVectorHandler& 
@@ -571,18 +2445,53 @@ CollisionWorld::AssRes(SubVectorHandler& WorkVec,
     const VectorHandler& XPrimeCurr)
 {
     DEBUGCOUT("Entering CollisionWorld::AssRes()" << std::endl);
-    for (std::map<FCL::ObjectPair, Collision*>::const_iterator it = objectpair_collision_map.begin();
-        it != objectpair_collision_map.end(); it++) {
-        it->second->ClearContacts();
+    const doublereal dStart(dGetWallTime());
+    candidates.clear();
+    if (!(bAsyncBroadphase && UseAsyncCandidates())) {
+        Broadphase();
     }
-    collision_manager->update();
-    collision_manager->collide(&objectpair_collision_map, CollisionFunction);
-    WorkVec.ResizeReset(iNumRows);
-    for (std::map<FCL::ObjectPair, Collision*>::const_iterator it = objectpair_collision_map.begin();
-        it != objectpair_collision_map.end(); it++) {
-        it->second->AssRes(WorkVec, dCoef, XCurr, XPrimeCurr);
+    if (bSleep && WakeIslands()) {
+        /* the woken objects were refit where they are now: look for their pairs again */
+        candidates.clear();
+        Broadphase();
     }
-    return WorkVec;
+    for (std::vector<PairMap>::const_iterator d = domain_pairs.begin(); d != domain_pairs.end(); d++) {
+        for (PairMap::const_iterator it = d->begin(); it != d->end(); it++) {
+            if (!it->second->IsSleeping()) {
+                it->second->ClearContacts();
+            }
+        }
+    }
+    if (bProcessRound) {
+        ApplyProcessContacts();
+    } else if (pSubdomains != NULL) {
+        IntersectSubdomains();
+    } else {
+        for (std::vector<Collision*>::const_iterator it = candidates.begin(); it != candidates.end(); it++) {
+            if (!(*it)->IsSleeping()) {
+                (*it)->Intersect();
+            }
+        }
+    }
+    GatherContacts(false);
+    if (blocks.empty()) {
+        WorkVec.ResizeReset(0);
+        dCollisionTime += dGetWallTime() - dStart;
+        return WorkVec;
+    }
+    ResizeWorkSpace();
+    pWorkVec->ResizeReset(CollisionBlock::iBlockSize * blocks.size());
+    integer iRow(0);
+    for (std::vector<CollisionBlock*>::const_iterator it = blocks.begin(); it != blocks.end(); it++) {
+        block_vec.ResizeReset(CollisionBlock::iBlockSize);
+        (*it)->AssRes(block_vec, dCoef, XCurr, XPrimeCurr);
+        for (int iCnt = 1; iCnt <= CollisionBlock::iBlockSize; iCnt++) {
+            pWorkVec->PutItem(iRow + iCnt, block_vec.iGetRowIndex(iCnt), block_vec.dGetCoef(iCnt));
+        }
+        iRow += CollisionBlock::iBlockSize;
+    }
+    dCollisionTime += dGetWallTime() - dStart;
+    return *pWorkVec;
 }
 
 VariableSubMatrixHandler& 
@@ -592,29 +2501,60 @@ CollisionWorld::AssJac(VariableSubMatrixHandler& WorkMat,
     const VectorHandler& XPrimeCurr)
 {
     DEBUGCOUT("Entering CollisionWorld::AssJac()" << std::endl);
-    FullSubMatrixHandler& WM = WorkMat.SetFull();
-    WM.ResizeReset(iNumRows, iNumCols);
-    for (std::map<FCL::ObjectPair, Collision*>::const_iterator it = objectpair_collision_map.begin();
-        it != objectpair_collision_map.end(); it++) {
-        it->second->AssJac(WorkMat, dCoef, XCurr, XPrimeCurr);
+    const doublereal dStart(dGetWallTime());
+    if (blocks.empty()) {
+        WorkMat.SetNullMatrix();
+        dCollisionTime += dGetWallTime() - dStart;
+        return WorkMat;
     }
-    return WorkMat;
+    ResizeWorkSpace();
+    /* the blocks are not coupled, so they go in as 12x12 items each rather than one dense square */
+    SparseSubMatrixHandler& WM = pWorkMat->SetSparse();
+    WM.ResizeReset(CollisionBlock::iBlockSize * CollisionBlock::iBlockSize * blocks.size(), 0);
+    integer iItem(1);
+    for (std::vector<CollisionBlock*>::const_iterator it = blocks.begin(); it != blocks.end(); it++) {
+        FullSubMatrixHandler& BM = block_mat.SetFull();
+        BM.ResizeReset(CollisionBlock::iBlockSize, CollisionBlock::iBlockSize);
+        (*it)->AssJac(block_mat, dCoef, XCurr, XPrimeCurr);
+        for (int iRow = 1; iRow <= CollisionBlock::iBlockSize; iRow++) {
+            for (int iCol = 1; iCol <= CollisionBlock::iBlockSize; iCol++) {
+                WM.PutItem(iItem++, BM.iGetRowIndex(iRow), BM.iGetColIndex(iCol), BM.dGetCoef(iRow, iCol));
+            }
+        }
+    }
+    dCollisionTime += dGetWallTime() - dStart;
+    return *pWorkMat;
 }
 
 unsigned int
 CollisionWorld::iGetNumPrivData(void) const
 {
-    // return number of private data
-    return 0;
+    return 8;
 }
 
 unsigned int
 CollisionWorld::iGetPrivDataIdx(const char *s) const
 {
-    // parse string and compute index of requested private data
-
-    // shouldn't get here until private data are defined
-    throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+    ASSERT(s != NULL);
+
+    if (strcmp(s, "time_step") == 0) {
+        return 1;
+    } else if (strcmp(s, "penetration") == 0) {
+        return 2;
+    } else if (strcmp(s, "approach_velocity") == 0) {
+        return 3;
+    } else if (strcmp(s, "new_contacts") == 0) {
+        return 4;
+    } else if (strcmp(s, "memory") == 0) {
+        return 5;
+    } else if (strcmp(s, "step_wall_time") == 0) {
+        return 6;
+    } else if (strcmp(s, "collision_time") == 0) {
+        return 7;
+    } else if (strcmp(s, "active_objects") == 0) {
+        return 8;
+    }
+    return 0;
 }
 
 doublereal
@@ -623,14 +2563,27 @@ CollisionWorld::dGetPrivData(unsigned int i) const
     ASSERT(0 < i && i <= iGetNumPrivData());
 
     switch (i) {
-        case 0:
+        case 1:
+            /* without hint parameters this is 0, which a time step drive can treat as no hint */
+            return dTimeStepHint;
+        case 2:
+            return dPenetration;
+        case 3:
+            return dApproachVelocity;
+        case 4:
+            return bNewContacts ? 1.0 : 0.0;
+        case 5:
+            return doublereal(iGetMemory());
+        case 6:
+            return dStepWallTime;
+        case 7:
+            return dStepCollisionTime;
+        case 8:
+            return doublereal(object_data.size());
         default:
             silent_cerr("collision world(" << GetLabel() << "): invalid private data index " << i << std::endl);
             throw ErrGeneric(MBDYN_EXCEPT_ARGS);
     }
-
-    // shouldn't get here until private data are defined
-    throw ErrGeneric(MBDYN_EXCEPT_ARGS);
 }
 
 std::ostream&
@@ -705,14 +2658,43 @@ UserDefinedElem(uLabel, pDO)
             "            (Mat3x3) <orientation>,\n"
             "        (str)<material>,\n"
             "        <shape> [,margin, (real)<margin>]\n"
+            "        [, activation, (DriveCaller)<drive>]\n"
             "\n"
             "   <shape> ::= {\n"
-//            "       Box, (real)<x_half_extent>, (real)<y_half_extent>, (real)<z_half_extent>\n"
-//            "       | Capsule, (real)<radius>, (real)<height>\n"
-//            "       | Cone, (real)<radius>, (real)<height>\n"
+            "       Box, (real)<x_half_extent>, (real)<y_half_extent>, (real)<z_half_extent>\n"
+            "       | Capsule, (real)<radius>, (real)<height>\n"
+            "       | Cone, (real)<radius>, (real)<height>\n"
+            "       | Cylinder, (real)<radius>, (real)<height>\n"
             "       | Sphere, (real)<radius>\n"
             "       | Plane\n"
-            "   }\n\n"
+            "       | Heightfield, (str)<file_name>\n"
+            "       | Mesh, (str)<file_name>\n"
+            "       | Sdf, (str)<file_name>\n"
+            "       | Compound, (integer)<number_of_shapes>,\n"
+            "           (Vec3) <offset>, (Mat3x3) <orientation>, <shape> [,...]\n"
+            "   }\n"
+            "\n"
+            "   The heightfield file is a binary grid of heights over the local x-y plane,\n"
+            "   see heightfield.h for its layout.\n"
+            "   The mesh file is a binary STL or a Wavefront OBJ file; its BVH is cached\n"
+            "   in <file_name>.bvh and reused while the mesh is unchanged.\n"
+            "   The sdf file is a binary voxel grid of signed distances, see sdf.h\n"
+            "   for its layout; it collides with spheres and capsules.\n"
+            "   Boxes, cones and cylinders, and capsules against capsules, collide\n"
+            "   through GJK/EPA, seeded with the last search direction of the pair;\n"
+            "   box-box, sphere-box and plane pairs are solved in closed form by FCL\n"
+            "   and ignore the seed.  The corners and rim points of boxes, cones and\n"
+            "   cylinders inside a box or a plane make a patch of up to\n"
+            "   <max_points_per_pair> points; otherwise one point is used.\n"
+            "   The shapes of a compound are placed relative to the node like the\n"
+            "   object itself; they share its material and margin and cannot be\n"
+            "   planes or compounds.  The broadphase sees the compound as one object\n"
+            "   and only the shapes near the other object are tested.\n"
+            "   With a margin, the object is paired with others that come within\n"
+            "   <margin> of it; such speculative contacts carry no force until\n"
+            "   the shapes actually touch.\n"
+            "   With activation, the object takes part in its world only while\n"
+            "   <drive> is not zero, as checked at each converged step.\n\n"
             << std::endl);
 
         if (!HP.IsArg()) {
@@ -724,42 +2706,124 @@ UserDefinedElem(uLabel, pDO)
     }
     pNode = pDM->ReadNode<const StructNode, Node::STRUCTURAL>(HP);
     const ReferenceFrame RF(pNode);
-    f = HP.GetPosRel(RF);
-    R = HP.GetRotRel(RF);
+    const Vec3 f(HP.GetPosRel(RF));
+    const Mat3x3 R(HP.GetRotRel(RF));
     Vec3 x(pNode->GetXCurr() + pNode->GetRCurr()*f);
     Mat3x3 r(pNode->GetRCurr()*R);
     fcl::Vec3f translate(x[0], x[1], x[2]);
     fcl::Matrix3f rotate(r.dGet(1,1),r.dGet(1,2),r.dGet(1,3),r.dGet(2,1),r.dGet(2,2),r.dGet(2,3),r.dGet(3,1),r.dGet(3,2),r.dGet(3,3));
     const TypedValue material(HP.GetValue(TypedValue::VAR_STRING));
-    /*if (HP.IsKeyWord("box")) {
+    if (HP.IsKeyWord("compound")) {
+        const int N(HP.GetInt());
+        if (N <= 0) {
+            silent_cerr("collision object(" << GetLabel() << "): invalid number of compound shapes at line " << HP.GetLineData() << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        }
+        FCL::Compound* pCompound(new FCL::Compound);
+        FCL::CollisionGeometryPtr_t fcl_shape(pCompound);
+        const Mat3x3 RT(R.Transpose());
+        for (int i = 0; i < N; i++) {
+            /* children are given relative to the node, like the object itself */
+            const Vec3 fc(RT*(HP.GetPosRel(RF) - f));
+            const Mat3x3 rc(RT*HP.GetRotRel(RF));
+            FCL::CollisionGeometryPtr_t child(ReadShape(HP));
+            if (child->getNodeType() == fcl::GEOM_PLANE) {
+                silent_cerr("collision object(" << GetLabel() << "): a plane cannot be part of a compound at line " << HP.GetLineData() << std::endl);
+                throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+            }
+            pCompound->Add(child, fcl::Transform3f(
+                fcl::Matrix3f(rc.dGet(1,1),rc.dGet(1,2),rc.dGet(1,3),rc.dGet(2,1),rc.dGet(2,2),rc.dGet(2,3),rc.dGet(3,1),rc.dGet(3,2),rc.dGet(3,3)),
+                fcl::Vec3f(fc[0], fc[1], fc[2])));
+        }
+        pCompound->Setup();
+        ob = new fcl::CollisionObject(fcl_shape, rotate, translate);
+    } else {
+        ob = new fcl::CollisionObject(ReadShape(HP), rotate, translate);
+    }
+    doublereal margin(0.);
+    if (HP.IsKeyWord("margin")) {
+        margin = HP.GetReal();
+        if (margin < 0.) {
+            silent_cerr("collision object(" << GetLabel() << "): invalid margin at line " << HP.GetLineData() << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        }
+        InflateAABB(ob->collisionGeometry().get(), margin);
+        ob->computeAABB();
+    }
+    if (HP.IsKeyWord("activation")) {
+        activation.Set(HP.GetDriveCaller());
+    }
+    const int iNodeType(ob->getNodeType());
+    const bool bTerrain(iNodeType == fcl::GEOM_PLANE || iNodeType == FCL::GEOM_HEIGHTFIELD || iNodeType == FCL::GEOM_SDF);
+    pData = new CollisionObjectData(pNode, ob, material.GetString(), f, R, bTerrain, margin, activation.pGetDriveCaller());
+    collision_object_data[uLabel] = std::vector<CollisionObjectData*>(1, pData);
+    SetOutputFlag(pDM->fReadOutput(HP, Elem::LOADABLE));
+}
+
+FCL::CollisionGeometryPtr_t
+CollisionObject::ReadShape(MBDynParser& HP) const
+{
+    if (HP.IsKeyWord("box")) {
         const float x(HP.GetReal());
         const float y(HP.GetReal());
         const float z(HP.GetReal());
         FCL::CollisionGeometryPtr_t fcl_shape(new fcl::Box(2 * x, 2 * y, 2 * z));
-        ob = new fcl::CollisionObject(fcl_shape, rotate, translate);
-    } else if (HP.IsKeyWord("capsule")) {
-        const float radius(HP.GetReal());
-        const float height(HP.GetReal());
-        FCL::CollisionGeometryPtr_t fcl_shape(new fcl::Capsule(radius, height));
-        ob = new fcl::CollisionObject(fcl_shape, rotate, translate);
+        return fcl_shape;
     } else if (HP.IsKeyWord("cone")) {
         const float radius(HP.GetReal());
         const float height(HP.GetReal());
         FCL::CollisionGeometryPtr_t fcl_shape(new fcl::Cone(radius, height));
-        ob = new fcl::CollisionObject(fcl_shape, rotate, translate);
-    } else */if (HP.IsKeyWord("plane")) {
+        return fcl_shape;
+    } else if (HP.IsKeyWord("cylinder")) {
+        const float radius(HP.GetReal());
+        const float height(HP.GetReal());
+        FCL::CollisionGeometryPtr_t fcl_shape(new fcl::Cylinder(radius, height));
+        return fcl_shape;
+    } else if (HP.IsKeyWord("capsule")) {
+        const float radius(HP.GetReal());
+        const float height(HP.GetReal());
+        FCL::CollisionGeometryPtr_t fcl_shape(new fcl::Capsule(radius, height));
+        return fcl_shape;
+    } else if (HP.IsKeyWord("heightfield")) {
+        const std::string file_name(HP.GetFileName());
+        FCL::CollisionGeometryPtr_t fcl_shape;
+        try {
+            fcl_shape.reset(new FCL::Heightfield(file_name));
+        } catch (const std::runtime_error& e) {
+            silent_cerr("collision object(" << GetLabel() << "): " << e.what() << " at line " << HP.GetLineData() << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        }
+        return fcl_shape;
+    } else if (HP.IsKeyWord("mesh")) {
+        const std::string file_name(HP.GetFileName());
+        FCL::CollisionGeometryPtr_t fcl_shape;
+        try {
+            fcl_shape.reset(new FCL::Mesh(file_name));
+        } catch (const std::runtime_error& e) {
+            silent_cerr("collision object(" << GetLabel() << "): " << e.what() << " at line " << HP.GetLineData() << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        }
+        return fcl_shape;
+    } else if (HP.IsKeyWord("sdf")) {
+        const std::string file_name(HP.GetFileName());
+        FCL::CollisionGeometryPtr_t fcl_shape;
+        try {
+            fcl_shape.reset(new FCL::DistanceField(file_name));
+        } catch (const std::runtime_error& e) {
+            silent_cerr("collision object(" << GetLabel() << "): " << e.what() << " at line " << HP.GetLineData() << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        }
+        return fcl_shape;
+    } else if (HP.IsKeyWord("plane")) {
         FCL::CollisionGeometryPtr_t fcl_shape(new fcl::Plane(0., 0., 1., 0.));
-        ob = new fcl::CollisionObject(fcl_shape, rotate, translate);
+        return fcl_shape;
     } else if (HP.IsKeyWord("sphere")) {
         const float radius(HP.GetReal());
         FCL::CollisionGeometryPtr_t fcl_shape(new fcl::Sphere(radius));
-        ob = new fcl::CollisionObject(fcl_shape, rotate, translate);
-    } else {
-        silent_cerr("collision object(" << GetLabel() << "): a valid shape is expected at line " << HP.GetLineData() << std::endl);
-        throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        return fcl_shape;
     }
-    collision_object_data[uLabel] = new CollisionObjectData(pNode, ob, material.GetString());
-    SetOutputFlag(pDM->fReadOutput(HP, Elem::LOADABLE));
+    silent_cerr("collision object(" << GetLabel() << "): a valid shape is expected at line " << HP.GetLineData() << std::endl);
+    throw ErrGeneric(MBDYN_EXCEPT_ARGS);
 }
 
 CollisionObject::~CollisionObject(void)
@@ -801,14 +2865,9 @@ CollisionObject::AssRes(SubVectorHandler& WorkVec,
 {
     DEBUGCOUT("Entering CollisionObject::AssRes()" << std::endl);
     WorkVec.ResizeReset(0);
-    if (ob->getNodeType() != fcl::GEOM_PLANE) {
-        Vec3 x(pNode->GetXCurr() + pNode->GetRCurr() * f);
-        Mat3x3 r(pNode->GetRCurr() * R);
-        ob->setTransform(
-            fcl::Matrix3f(r.dGet(1,1),r.dGet(1,2),r.dGet(1,3),r.dGet(2,1),r.dGet(2,2),r.dGet(2,3),r.dGet(3,1),r.dGet(3,2),r.dGet(3,3)),
-            fcl::Vec3f(x[0], x[1], x[2]));
-        ob->computeAABB();
-    }    
+    if (pData->bActive && (pData->pNodeData == NULL || !pData->pNodeData->bSleeping)) {
+        pData->UpdateTransform();
+    }
     return WorkVec;
 }
 
@@ -902,6 +2961,256 @@ CollisionObject::InitialAssRes(
 
 // CollisionObject: end
 
+// CollisionParticles: begin
+
+CollisionParticles::CollisionParticles(
+    unsigned uLabel, const DofOwner *pDO,
+    DataManager* pDM, MBDynParser& HP)
+: Elem(uLabel, flag(0)),
+UserDefinedElem(uLabel, pDO)
+{
+    if (HP.IsKeyWord("help")) {
+        silent_cout(
+            "\n"
+            "Module:     Collision\n"
+            "\n"
+            "    This element implements a cloud of spherical collision objects,\n"
+            "    one centered on each structural node of a label range\n"
+            "\n"
+            "    collision particles,\n"
+            "        (Node) <first_label>, (Node) <last_label>,\n"
+            "        (str)<material>,\n"
+            "        { radius, (real)<radius>\n"
+            "        | radius table, (real)<radius> [,...] }\n"
+            "        [, margin, (real)<margin>]\n"
+            "        [, activation, (DriveCaller)<drive>]\n"
+            "\n"
+            "    The radius table holds one radius per label in the range.\n"
+            "    With activation, the particles take part in their world only while\n"
+            "    <drive> is not zero.\n"
+            "\n"
+            << std::endl);
+
+        if (!HP.IsArg()) {
+            /*
+             * Exit quietly if nothing else is provided
+             */
+            throw NoErr(MBDYN_EXCEPT_ARGS);
+        }
+    }
+    const unsigned uFirst(HP.GetInt());
+    const unsigned uLast(HP.GetInt());
+    if (uLast < uFirst) {
+        silent_cerr("collision particles(" << GetLabel() << "): invalid label range at line " << HP.GetLineData() << std::endl);
+        throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+    }
+    const unsigned N(uLast - uFirst + 1);
+    const TypedValue material(HP.GetValue(TypedValue::VAR_STRING));
+    radius.resize(N);
+    if (HP.IsKeyWord("radius")) {
+        const doublereal r(HP.GetReal());
+        for (unsigned i = 0; i < N; i++) {
+            radius[i] = r;
+        }
+    } else if (HP.IsKeyWord("radius" "table")) {
+        for (unsigned i = 0; i < N; i++) {
+            radius[i] = HP.GetReal();
+        }
+    } else {
+        silent_cerr("collision particles(" << GetLabel() << "): radius or radius table expected at line " << HP.GetLineData() << std::endl);
+        throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+    }
+    doublereal margin(0.);
+    if (HP.IsKeyWord("margin")) {
+        margin = HP.GetReal();
+        if (margin < 0.) {
+            silent_cerr("collision particles(" << GetLabel() << "): invalid margin at line " << HP.GetLineData() << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        }
+    }
+    if (HP.IsKeyWord("activation")) {
+        activation.Set(HP.GetDriveCaller());
+    }
+    pNodes.resize(N);
+    obs.reserve(N);
+    data.reserve(N);
+    std::vector<CollisionObjectData*> element_objects;
+    element_objects.reserve(N);
+    /* spheres of equal radius share one geometry */
+    std::map<doublereal, FCL::CollisionGeometryPtr_t> shapes;
+    const fcl::Matrix3f rotate(1., 0., 0., 0., 1., 0., 0., 0., 1.);
+    for (unsigned i = 0; i < N; i++) {
+        pNodes[i] = pDM->pFindNode<const StructNode, Node::STRUCTURAL>(uFirst + i);
+        if (pNodes[i] == NULL) {
+            silent_cerr("collision particles(" << GetLabel() << "): structural node(" << uFirst + i << ") is undefined" << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        }
+        if (!(radius[i] > 0.0)) {
+            silent_cerr("collision particles(" << GetLabel() << "): invalid radius for structural node(" << uFirst + i << ")" << std::endl);
+            throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+        }
+        if (shapes.find(radius[i]) == shapes.end()) {
+            shapes[radius[i]] = FCL::CollisionGeometryPtr_t(new fcl::Sphere(radius[i]));
+        }
+        const Vec3& X(pNodes[i]->GetXCurr());
+        obs.push_back(fcl::CollisionObject(shapes[radius[i]], rotate, fcl::Vec3f(X(1), X(2), X(3))));
+        data.push_back(CollisionObjectData(pNodes[i], &obs[i], material.GetString(), Zero3, Eye3, false, margin, activation.pGetDriveCaller()));
+        element_objects.push_back(&data[i]);
+    }
+    if (margin > 0.) {
+        /* fcl::CollisionObject recomputes the local AABB of its geometry on construction */
+        for (std::map<doublereal, FCL::CollisionGeometryPtr_t>::iterator it = shapes.begin(); it != shapes.end(); it++) {
+            InflateAABB(it->second.get(), margin);
+        }
+        for (std::vector<fcl::CollisionObject>::iterator it = obs.begin(); it != obs.end(); it++) {
+            it->computeAABB();
+        }
+    }
+    collision_object_data[uLabel] = element_objects;
+    SetOutputFlag(pDM->fReadOutput(HP, Elem::LOADABLE));
+}
+
+CollisionParticles::~CollisionParticles(void)
+{
+    NO_OP;
+}
+
+void
+CollisionParticles::Output(OutputHandler& OH) const
+{
+    if (fToBeOutput()) {
+        NO_OP;
+    }
+}
+
+void
+CollisionParticles::WorkSpaceDim(integer* piNumRows, integer* piNumCols) const
+{
+    *piNumRows = 0;
+    *piNumCols = 0;
+}
+
+VariableSubMatrixHandler& 
+CollisionParticles::AssJac(VariableSubMatrixHandler& WorkMat,
+    doublereal dCoef, 
+    const VectorHandler& XCurr,
+    const VectorHandler& XPrimeCurr)
+{
+    DEBUGCOUT("Entering CollisionParticles::AssJac()" << std::endl);
+    WorkMat.SetNullMatrix();
+    return WorkMat;
+}
+
+SubVectorHandler& 
+CollisionParticles::AssRes(SubVectorHandler& WorkVec,
+    doublereal dCoef,
+    const VectorHandler& XCurr, 
+    const VectorHandler& XPrimeCurr)
+{
+    DEBUGCOUT("Entering CollisionParticles::AssRes()" << std::endl);
+    WorkVec.ResizeReset(0);
+    const std::size_t N(pNodes.size());
+    /* spheres need no rotation, so the AABB is a plain translation of the local one */
+    for (std::size_t i = 0; i < N; i++) {
+        if (data[i].bActive && (data[i].pNodeData == NULL || !data[i].pNodeData->bSleeping)) {
+            const Vec3& X(pNodes[i]->GetXCurr());
+            obs[i].setTranslation(fcl::Vec3f(X(1), X(2), X(3)));
+            obs[i].computeAABB();
+        }
+    }
+    return WorkVec;
+}
+
+unsigned int
+CollisionParticles::iGetNumPrivData(void) const
+{
+    return 0;
+}
+
+unsigned int
+CollisionParticles::iGetPrivDataIdx(const char *s) const
+{
+    throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+}
+
+doublereal
+CollisionParticles::dGetPrivData(unsigned int i) const
+{
+    ASSERT(i > 1 && i <= iGetNumPrivData());
+    throw ErrGeneric(MBDYN_EXCEPT_ARGS);
+}
+
+int
+CollisionParticles::iGetNumConnectedNodes(void) const
+{
+    return 0;
+}
+
+void
+CollisionParticles::GetConnectedNodes(std::vector<const Node *>& connectedNodes) const
+{
+    connectedNodes.resize(0);
+}
+
+void
+CollisionParticles::SetValue(DataManager *pDM,
+    VectorHandler& X, VectorHandler& XP,
+    SimulationEntity::Hints *ph)
+{
+    NO_OP;
+}
+
+std::ostream&
+CollisionParticles::Restart(std::ostream& out) const
+{
+    return out << "# CollisionParticles: not implemented" << std::endl;
+}
+
+unsigned int
+CollisionParticles::iGetInitialNumDof(void) const
+{
+    return 0;
+}
+
+void 
+CollisionParticles::InitialWorkSpaceDim(
+    integer* piNumRows,
+    integer* piNumCols) const
+{
+    *piNumRows = 0;
+    *piNumCols = 0;
+}
+
+VariableSubMatrixHandler&
+CollisionParticles::InitialAssJac(
+    VariableSubMatrixHandler& WorkMat, 
+    const VectorHandler& XCurr)
+{
+    // should not be called, since initial workspace is empty
+    ASSERT(0);
+    DEBUGCOUT("Entering CollisionParticles::InitialAssJac()" << std::endl);
+
+    WorkMat.SetNullMatrix();
+
+    return WorkMat;
+}
+
+SubVectorHandler& 
+CollisionParticles::InitialAssRes(
+    SubVectorHandler& WorkVec,
+    const VectorHandler& XCurr)
+{
+    // should not be called, since initial workspace is empty
+    ASSERT(0);
+    DEBUGCOUT("Entering CollisionParticles::InitialAssRes()" << std::endl);
+
+    WorkVec.ResizeReset(0);
+
+    return WorkVec;
+}
+
+// CollisionParticles: end
+
 bool module_read(void)
 {
     UserDefinedElemRead *rf1 = new UDERead<CollisionWorld>;
@@ -917,6 +3226,14 @@ bool module_read(void)
         delete rf2;
         return false;
     }
+    UserDefinedElemRead *rf3 = new UDERead<CollisionParticles>;
+    if (!SetUDE("collision" "particles", rf3))
+    {
+        delete rf1;
+        delete rf2;
+        delete rf3;
+        return false;
+    }
     return true;
 }
 
@@ -34,56 +34,259 @@
 #ifndef MODULE_COLLISION_H
 #define MODULE_COLLISION_H
 
+#include <cmath>
+
 #include "intersect.h"
+#include "contactstream.h"
+#include "subdomains.h"
+#include "workerprocesses.h"
+#ifdef USE_MULTITHREAD
+#include <pthread.h>
+#endif
 
-class Contact {
+/*
+ * The contacts of all the pairs of a world, one array per field.  The contacts
+ * of a pair are contiguous and the pairs follow the order of their blocks, so
+ * assembly and output stream through each array; pair is the index of the
+ * owning pair in that order.  The world rebuilds it after each narrowphase.
+ */
+class ContactBuffer {
+public:
+    std::vector<unsigned> pair;
+    std::vector<Vec3> f1;
+    std::vector<Vec3> f2;
+    std::vector<Vec3> Arm1;
+    std::vector<Vec3> tangent;
+    std::vector<Vec3> s1;
+    std::vector<Vec3> s2;
+    std::vector<Vec3> Ft;
+    std::vector<doublereal> Fn_Norm;
+    std::vector<char> bSlip;
+    std::size_t Size(void) const;
+    void Clear(void);
+    void Swap(ContactBuffer& other);
+    std::size_t iGetMemory(void) const;
+    /* a new contact, sticking where it is found */
+    void Add(unsigned iPair, const std::pair<fcl::Vec3f, fcl::Vec3f>& pt_pair,
+        const StructDispNode* pNode1, const StructDispNode* pNode2, doublereal penetration_ratio);
+    /* contact i of other, for pair iPair */
+    void Append(unsigned iPair, const ContactBuffer& other, std::size_t i);
+};
+
+/* what a contact carries over to the next step, matched to the new contact nearest f1 */
+class ContactHistory {
 public:
-    Contact(std::pair<fcl::Vec3f, fcl::Vec3f> pt_pair, const StructDispNode* pNode1, const StructDispNode* pNode2, doublereal penetration_ratio);
-    ~Contact(void);
-    Vec3 Arm1;
     Vec3 f1;
-    Vec3 f2;
-    Vec3 Ft;
-    doublereal Fn_Norm;
     Vec3 tangent;
+    Vec3 s1;
+    Vec3 s2;
+};
+
+/* contact laws evaluated inline, see CollisionMaterial */
+enum ContactLawType {
+    CONTACT_LAW_GENERIC,
+    CONTACT_LAW_LINEAR,
+    CONTACT_LAW_HERTZ
+};
+
+template <ContactLawType law>
+struct ContactLaw;
+
+/* F = K depth + C Vn; p = {K, C} */
+template <>
+struct ContactLaw<CONTACT_LAW_LINEAR> {
+    static inline void
+    Evaluate(const doublereal* p, doublereal depth, doublereal Vn, doublereal& F, doublereal& FDE, doublereal& FDEPrime) {
+        F = p[0] * depth + p[1] * Vn;
+        FDE = p[0];
+        FDEPrime = p[1];
+    };
+};
+
+/* Hertz with Hunt-Crossley damping, F = depth^e (K + C Vn); p = {K, e, C} */
+template <>
+struct ContactLaw<CONTACT_LAW_HERTZ> {
+    static inline void
+    Evaluate(const doublereal* p, doublereal depth, doublereal Vn, doublereal& F, doublereal& FDE, doublereal& FDEPrime) {
+        if (!(depth > 0.)) {
+            F = 0.;
+            FDE = 0.;
+            FDEPrime = 0.;
+            return;
+        }
+        const doublereal dn(std::pow(depth, p[1]));
+        F = dn * (p[0] + p[2] * Vn);
+        FDE = p[1] * F / depth;
+        FDEPrime = p[2] * dn;
+    };
+};
+
+/*
+ * Contact law of a material pair, held once by the world and shared by all
+ * its pairs.  MBDyn's linear viscoelastic law without prestress or prestrain
+ * and the hertz law of the material pair are evaluated through ContactLaw
+ * without virtual calls; any other constitutive law is evaluated as a function
+ * of (depth, Vn) only.  Per-contact history lives in ContactBuffer and ContactHistory.
+ */
+class CollisionMaterial {
+public:
+    CollisionMaterial(const ConstitutiveLaw1D* pCL, const BasicScalarFunction* pSF,
+        doublereal penetration_ratio, doublereal dStickStiffness, bool bGeneric = false);
+    CollisionMaterial(doublereal K, doublereal e, doublereal C, const BasicScalarFunction* pSF,
+        doublereal penetration_ratio, doublereal dStickStiffness);
+    ~CollisionMaterial(void);
+    void Evaluate(doublereal depth, doublereal Vn, doublereal& F, doublereal& FDE, doublereal& FDEPrime);
+    doublereal dGetFrictionDiff(doublereal v) const;
+    const BasicScalarFunction* const pSF;
+    const doublereal penetration_ratio;
+    const doublereal dStickStiffness;
+    std::size_t iMaxContacts;
+private:
+    ConstitutiveLaw1D* pCL;
+    ContactLawType law;
+    doublereal law_params[3];
+};
+
+class CollisionNodeData {
+public:
+    CollisionNodeData(const StructNode* pNode);
+    ~CollisionNodeData(void);
+    CollisionNodeData* Find(void);
+    void Union(CollisionNodeData* pOther);
+    const StructNode* pNode;
+    bool bTerrain;
+    bool bSleeping;
+    bool bIslandQuiet;
+    integer iQuietSteps;
+    CollisionNodeData* pIsland;
 };
 
 class CollisionObjectData {
 public:
-    CollisionObjectData(const StructNode* pNode, fcl::CollisionObject* pObject, std::string material);
+    CollisionObjectData(const StructNode* pNode, fcl::CollisionObject* pObject, std::string material,
+        const Vec3& f, const Mat3x3& R, bool bTerrain, doublereal margin,
+        const DriveCaller* pActivation = NULL);
     ~CollisionObjectData(void);
+    void UpdateTransform(void);
     const StructNode* pNode;
     fcl::CollisionObject* pObject;
     std::string material;
+    const Vec3 f;
+    const Mat3x3 R;
+    const bool bTerrain;
+    const doublereal margin;
+    /* the object takes part in its world while this drive is not zero, if any */
+    const DriveCaller* pActivation;
+    bool bActive;
+    CollisionNodeData* pNodeData;
 };
 
-class Collision :
-public ConstitutiveLaw1DOwner {
+class Collision {
 private:
-	const StructDispNode* pNode1;
-	const StructDispNode* pNode2;
+    static const int iNumRowsNode = 6;
+    static const int iNumColsNode = 6;
+    const StructDispNode* pNode1;
+    const StructDispNode* pNode2;
     fcl::CollisionObject* pObject1;
     fcl::CollisionObject* pObject2;
-    const BasicScalarFunction* pSF;
-    const doublereal penetration_ratio;
-    integer iR;
-    integer iC;
-    int iNumRowsNode;
-    int iNumColsNode;
-    std::vector<doublereal> dEpsilonPrime;
-    std::vector<Contact> contacts;
-    void AssMat(FullSubMatrixHandler& WM, doublereal dCoef, Contact& contact);
-    void AssVec(SubVectorHandler& WorkVec, doublereal dCoef, Contact& contact);
     FCL::Func func;
-    std::vector<Vec3> tangents;
+    FCL::NarrowphaseCache cache;
+    CollisionMaterial* pMaterial;
+    const doublereal dMargin;
+    /* first row and column of each node within the block */
+    integer iR1;
+    integer iC1;
+    integer iR2;
+    integer iC2;
+    /* what the narrowphase found, and where the contacts lie in the world's buffer */
+    FCL::Vec3f_pairs found;
+    ContactBuffer* pBuffer;
+    std::size_t iFirst;
+    std::size_t iNumContacts;
+    std::vector<ContactHistory> history;
+    CollisionNodeData* pNodeData1;
+    CollisionNodeData* pNodeData2;
+    integer iNumClosed;
+    std::size_t iLastNumContacts;
+    const bool bSwapped;
+    bool bSleeping;
+    integer iGetNumClosedContacts(void) const;
+    void MatchHistory(ContactBuffer& to, std::size_t iNewFirst) const;
+    void AssMat(FullSubMatrixHandler& WM, doublereal dCoef, std::size_t i);
+    void AssVec(SubVectorHandler& WorkVec, doublereal dCoef, std::size_t i);
 public:
-    Collision(FCL::Func func,
-        const ConstitutiveLaw1D* pCL, const BasicScalarFunction* pSFTmp, const doublereal penetration_ratio,
-        const CollisionObjectData* pD1, const CollisionObjectData* pD2, integer* iRow, integer* iCol);
+    Collision(FCL::Func func, CollisionMaterial* pMaterial, bool bSwapped,
+        const CollisionObjectData* pD1, const CollisionObjectData* pD2, ContactBuffer* pBuffer);
+    void SetBlock(const StructDispNode* pBlockNode1, integer iBlockRow, integer iBlockCol);
     void Intersect(void);
+    /* what Intersect found, or takes it from n contact points of 6 numbers each, pt1 then pt2 */
+    const FCL::Vec3f_pairs& GetFound(void) const;
+    void SetFound(const fcl::FCL_REAL* points, std::size_t n);
+    /* appends the found contacts to to, or with bKeep those already in the buffer */
+    void Gather(ContactBuffer& to, unsigned iPair, bool bKeep);
     void ClearContacts(void);
     void ClearAndSetTangents(void);
-    std::ostream& OutputAppend(std::ostream& out) const;
+    void CommitStick(void);
+    std::size_t iGetMemory(void) const;
+    bool UpdateContactState(doublereal& dMaxDepth, doublereal& dMaxApproach);
+    bool HasContacts(void) const;
+    bool IsSleeping(void) const;
+    void SetSleeping(bool bSleep);
+    fcl::CollisionObject* pGetObject1(void) const;
+    fcl::CollisionObject* pGetObject2(void) const;
+    bool IsThreadSafe(void) const;
+    CollisionNodeData* pGetNodeData1(void) const;
+    CollisionNodeData* pGetNodeData2(void) const;
+    /* appends contact i of the buffer */
+    std::ostream& OutputAppend(std::ostream& out, std::size_t i) const;
+    void StreamAppend(std::vector<ContactStreamRecord>& records) const;
+    /* appends the contact count and stick or slip of each contact, and their depths */
+    void GetContactState(std::vector<integer>& state, std::vector<doublereal>& depths) const;
+    void AssJac(FullSubMatrixHandler& WM, doublereal dCoef);
+    void AssRes(SubVectorHandler& WorkVec, doublereal dCoef);
+};
+
+/*
+ * The pairs between the same two nodes share one 12x12 block of the world's
+ * workspace, laid out for pNode1 first; each pair adds its contacts into it.
+ */
+class CollisionBlock {
+private:
+    static const int iNumRowsNode = 6;
+    static const int iNumColsNode = 6;
+public:
+    static const int iBlockSize = 2 * iNumRowsNode;
+private:
+    const StructDispNode* pNode1;
+    const StructDispNode* pNode2;
+    std::vector<Collision*> pairs;
+    bool bSleeping;
+    bool bFrozenRes;
+    bool bFrozenJac;
+    doublereal dFrozenCoef;
+    /* residual, then Jacobian, captured while asleep or in frozen Jacobian mode */
+    std::vector<doublereal> frozen;
+    /* negative unless the Jacobian is frozen while contacts persist */
+    doublereal dJacobianTolerance;
+    std::vector<integer> state;
+    std::vector<doublereal> depths;
+    std::vector<integer> frozen_state;
+    std::vector<doublereal> frozen_depths;
+    bool IsJacobianCurrent(void);
+public:
+    /* assembles into the first 12 rows and columns of the handlers it is given */
+    CollisionBlock(const StructDispNode* pNode1, const StructDispNode* pNode2);
+    void Add(Collision* pCollision);
+    void Remove(Collision* pCollision);
+    bool IsEmpty(void) const;
+    void SetJacobianTolerance(doublereal dTolerance);
+    std::size_t iGetMemory(void) const;
+    bool IsSleeping(void) const;
+    void SetSleeping(bool bSleep);
+    CollisionNodeData* pGetNodeData1(void) const;
+    CollisionNodeData* pGetNodeData2(void) const;
+    void ClearContacts(void);
+    void Gather(ContactBuffer& to, std::vector<Collision*>& order, bool bKeep);
 
     VariableSubMatrixHandler&
     AssJac(VariableSubMatrixHandler& WorkMat,
@@ -98,16 +301,150 @@ public:
         const VectorHandler& XPrimeCurr);
 };
 
+/*
+ * The memory a collision world shares with its worker processes.  Before each
+ * round the solver writes a ProcessRound, the boundaries of the subdomains and
+ * 12 numbers per active object, its rotation by rows then its position.  Each
+ * worker answers with a ProcessResults, room for a fixed number of ProcessPairs,
+ * then room for the contact points of those pairs, 6 numbers each; objects are
+ * given by their index among the active objects.
+ */
+struct ProcessRound {
+    int32_t axis;
+    uint32_t num_objects;
+};
+
+struct ProcessResults {
+    uint32_t num_pairs;
+    uint32_t num_points;
+    uint32_t overflow;          /* the pairs or the points did not fit */
+    uint32_t reserved;
+};
+
+struct ProcessPair {
+    uint32_t object1;
+    uint32_t object2;
+    uint32_t first;
+    uint32_t count;
+};
+
 class CollisionWorld
 : virtual public Elem, public UserDefinedElem {
 private:
-    integer iNumRows;
-    integer iNumCols;
+    typedef std::pair<std::string, std::string> MaterialPair;
+    typedef std::pair<const StructNode*, const StructNode*> NodePair;
+    /* assembly goes to handlers of this element, grown with the blocks in use */
+    integer iWorkRows;
+    MySubVectorHandler* pWorkVec;
+    VariableSubMatrixHandler* pWorkMat;
+    MySubVectorHandler block_vec;
+    VariableSubMatrixHandler block_mat;
+    void ResizeWorkSpace(void);
     fcl::BroadPhaseCollisionManager* collision_manager;
-    std::map<const FCL::ObjectPair, Collision*> objectpair_collision_map;
+    /* the pairs of each subdomain by their objects, or of the world without subdomains */
+    typedef std::map<const FCL::ObjectPair, Collision*> PairMap;
+    std::vector<PairMap> domain_pairs;
+    static PairMap::iterator FindPair(PairMap& pair_map, fcl::CollisionObject* o1, fcl::CollisionObject* o2);
+    std::vector<CollisionBlock*> blocks;
+    /* the pairs in the order of their contacts, which the buffer is rebuilt into */
+    std::vector<Collision*> pairs;
+    ContactBuffer contacts;
+    ContactBuffer gathered;
+    void GatherContacts(bool bKeep);
+    std::vector<CollisionMaterial*> materials;
+    std::map<MaterialPair, CollisionMaterial*> material_pairs;
+    std::map<NodePair, CollisionBlock*> node_pair_block;
+    doublereal dJacobianTolerance;
     std::set<const Node*> nodes;
     std::ostringstream ss;
     FCL::FuncMatrix func_matrix;
+    /* the active objects; all_object_data also holds those switched off */
+    std::vector<CollisionObjectData*> object_data;
+    std::vector<CollisionObjectData*> all_object_data;
+    bool bActivation;
+    bool bActiveRegion;
+    fcl::AABB active_region;
+    /* pairs and their blocks are made on the first broadphase hit, and released when no longer hit */
+    bool IsPairable(const CollisionObjectData* pD1, const CollisionObjectData* pD2) const;
+    Collision* AddPair(PairMap& pair_map, CollisionObjectData* pD1, CollisionObjectData* pD2);
+    void AddCandidate(fcl::CollisionObject* o1, fcl::CollisionObject* o2);
+    void RemovePair(Collision* pCollision);
+    void ReleaseEmptyBlocks(void);
+    void ReleasePairs(void);
+    void UpdateActivation(void);
+    std::map<const StructNode*, CollisionNodeData*> node_data;
+    std::vector<Collision*> candidates;
+    struct IntersectData {
+        std::vector<std::vector<Collision*> >* pCandidates;
+        std::size_t first;
+        std::size_t stride;
+    };
+    FCL::SubdomainCollisionManager* pSubdomains;
+    unsigned iNumThreads;
+    std::vector<std::vector<Collision*> > domain_candidates;
+    static void* IntersectThread(void* arg);
+    void IntersectSubdomains(void);
+    /* with processes, workers forked from the solver search and intersect the subdomains */
+    unsigned iNumProcesses;
+    WorkerProcesses* pProcesses;
+    std::size_t iProcessPairs;
+    std::size_t iProcessPoints;
+    std::map<const fcl::CollisionObject*, uint32_t> process_index;
+    /* the record and the contact points of each candidate of the last round */
+    std::vector<std::pair<const ProcessPair*, const fcl::FCL_REAL*> > process_hits;
+    bool bProcessRound;
+    void SpawnProcesses(void);
+    bool BroadphaseProcesses(void);
+    void ApplyProcessContacts(void);
+    void WorkProcess(unsigned worker, const void* common, void* results);
+    static void ProcessWork(unsigned worker, void* arg, const void* common, void* results);
+    /* candidates for the next step, built between convergence and prediction */
+    bool bAsyncBroadphase;
+    doublereal dAsyncInflation;
+    doublereal dAsyncTime;
+    doublereal dAsyncStep;
+    bool bAsyncRunning;
+    bool bAsyncReady;
+#ifdef USE_MULTITHREAD
+    pthread_t async_thread;
+#endif
+    std::vector<fcl::AABB> swept;
+    std::vector<FCL::ObjectPair> async_candidates;
+    void PredictBroadphase(void);
+    void BuildCandidates(void);
+    void JoinBroadphase(void);
+    static void* BroadphaseThread(void* arg);
+    bool UseAsyncCandidates(void);
+    /* wall clock of the last converged step, and of this element within it */
+    doublereal dStepStart;
+    doublereal dStepWallTime;
+    doublereal dCollisionTime;
+    doublereal dStepCollisionTime;
+    std::vector<fcl::CollisionObject*> awake_objects;
+    bool bSleep;
+    doublereal dSleepVelocity;
+    doublereal dSleepAngularVelocity;
+    integer iSleepSteps;
+    const DataManager* pDM;
+    bool bTimeStepHint;
+    doublereal dMaxPenetration;
+    doublereal dMaxPenetrationIncrement;
+    doublereal dMinTimeStep;
+    doublereal dMaxTimeStep;
+    doublereal dLastTime;
+    doublereal dTimeStepHint;
+    doublereal dPenetration;
+    doublereal dApproachVelocity;
+    bool bNewContacts;
+    ContactStream* pStream;
+    uint64_t iStep;
+    std::vector<ContactStreamRecord> records;
+    void UpdateTimeStepHint(void);
+    std::size_t iGetMemory(void) const;
+    void Broadphase(void);
+    void UpdateIslands(void);
+    /* true if an island was woken, whose objects were refit */
+    bool WakeIslands(void);
 public:
     CollisionWorld(unsigned uLabel, const DofOwner *pDO,
         DataManager* pDM, MBDynParser& HP);
@@ -121,6 +458,7 @@ public:
     void GetConnectedNodes(std::vector<const Node *>& connectedNodes) const;
     std::ostream& Restart(std::ostream& out) const;
     unsigned int iGetInitialNumDof(void) const;
+    static bool CollisionFunction(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* cdata_);
 
     void
     AfterPredict(VectorHandler& X, VectorHandler& XP);
@@ -158,9 +496,10 @@ class CollisionObject
 : virtual public Elem, public UserDefinedElem {
 private:
     const StructNode* pNode;
-    Vec3 f;
-    Mat3x3 R;
     fcl::CollisionObject* ob;
+    CollisionObjectData* pData;
+    DriveOwner activation;
+    FCL::CollisionGeometryPtr_t ReadShape(MBDynParser& HP) const;
 public:
     CollisionObject(unsigned uLabel, const DofOwner *pDO,
         DataManager* pDM, MBDynParser& HP);
@@ -199,4 +538,50 @@ public:
     InitialAssRes(SubVectorHandler& WorkVec, const VectorHandler& XCurr);
 };
 
+class CollisionParticles
+: virtual public Elem, public UserDefinedElem {
+private:
+    std::vector<const StructNode*> pNodes;
+    std::vector<doublereal> radius;
+    std::vector<fcl::CollisionObject> obs;
+    std::vector<CollisionObjectData> data;
+    DriveOwner activation;
+public:
+    CollisionParticles(unsigned uLabel, const DofOwner *pDO,
+        DataManager* pDM, MBDynParser& HP);
+    ~CollisionParticles(void);
+    void Output(OutputHandler& OH) const;
+    void WorkSpaceDim(integer* piNumRows, integer* piNumCols) const;
+    unsigned int iGetNumPrivData(void) const;
+    unsigned int iGetPrivDataIdx(const char *s) const;
+    doublereal dGetPrivData(unsigned int i) const;
+    int iGetNumConnectedNodes(void) const;
+    void GetConnectedNodes(std::vector<const Node *>& connectedNodes) const;
+    std::ostream& Restart(std::ostream& out) const;
+    unsigned int iGetInitialNumDof(void) const;
+    void InitialWorkSpaceDim(integer* piNumRows, integer* piNumCols) const;
+
+    VariableSubMatrixHandler& 
+    AssJac(VariableSubMatrixHandler& WorkMat,
+        doublereal dCoef, 
+        const VectorHandler& XCurr,
+        const VectorHandler& XPrimeCurr);
+
+    SubVectorHandler& 
+    AssRes(SubVectorHandler& WorkVec,
+        doublereal dCoef,
+        const VectorHandler& XCurr, 
+        const VectorHandler& XPrimeCurr);
+
+    void
+    SetValue(DataManager *pDM, VectorHandler& X, VectorHandler& XP,
+        SimulationEntity::Hints *ph);
+
+    VariableSubMatrixHandler&
+    InitialAssJac(VariableSubMatrixHandler& WorkMat, const VectorHandler& XCurr);
+
+    SubVectorHandler& 
+    InitialAssRes(SubVectorHandler& WorkVec, const VectorHandler& XCurr);
+};
+
 #endif
@@ -0,0 +1,120 @@
+#include "mbconfig.h"           /* This goes first in every *.c,*.cc file */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "intersect.h"
+#include "mappedfile.h"
+
+namespace FCL
+{
+
+namespace
+{
+const std::size_t header_size(64);
+}
+
+DistanceField::DistanceField(const std::string& file_name)
+: pMap(MAP_FAILED),
+map_size(0),
+pDistances(NULL)
+{
+    MappedFile file(file_name);
+    if (file.p == MAP_FAILED) {
+        throw std::runtime_error("unable to map distance field file \"" + file_name + "\"");
+    }
+    if (file.size < header_size) {
+        throw std::runtime_error("distance field file \"" + file_name + "\" is truncated");
+    }
+    const char* p(static_cast<const char*>(file.p));
+    uint32_t n[3];
+    double header[4];
+    std::memcpy(n, p + 4, sizeof(n));
+    std::memcpy(header, p + 16, sizeof(header));
+    nx = n[0];
+    ny = n[1];
+    nz = n[2];
+    x0 = header[0];
+    y0 = header[1];
+    z0 = header[2];
+    h = header[3];
+    if (std::memcmp(p, "SDFV", 4) != 0 || nx < 2 || ny < 2 || nz < 2 || !(h > 0.0)
+        || file.size != header_size + std::size_t(nx) * std::size_t(ny) * std::size_t(nz) * sizeof(float)) {
+        throw std::runtime_error("distance field file \"" + file_name + "\" has an invalid header");
+    }
+    pDistances = reinterpret_cast<const float*>(p + header_size);
+    pMap = file.p;
+    map_size = file.size;
+    file.Release();
+    computeLocalAABB();
+}
+
+DistanceField::~DistanceField(void)
+{
+    if (pMap != MAP_FAILED) {
+        munmap(pMap, map_size);
+    }
+}
+
+void
+DistanceField::computeLocalAABB(void)
+{
+    aabb_local = fcl::AABB(fcl::Vec3f(x0, y0, z0), fcl::Vec3f(x0 + (nx - 1) * h, y0 + (ny - 1) * h, z0 + (nz - 1) * h));
+    aabb_center = aabb_local.center();
+    aabb_radius = (aabb_local.min_ - aabb_center).length();
+}
+
+fcl::NODE_TYPE
+DistanceField::getNodeType(void) const
+{
+    return fcl::NODE_TYPE(GEOM_SDF);
+}
+
+fcl::FCL_REAL
+DistanceField::GetCellSize(void) const
+{
+    return h;
+}
+
+bool
+DistanceField::Distance(const fcl::Vec3f& p, fcl::FCL_REAL& d, fcl::Vec3f& gradient) const
+{
+    const fcl::FCL_REAL gx((p[0] - x0) / h);
+    const fcl::FCL_REAL gy((p[1] - y0) / h);
+    const fcl::FCL_REAL gz((p[2] - z0) / h);
+    if (!(gx >= 0.0 && gx <= nx - 1 && gy >= 0.0 && gy <= ny - 1 && gz >= 0.0 && gz <= nz - 1)) {
+        return false;
+    }
+    const unsigned i(std::min(unsigned(gx), nx - 2));
+    const unsigned j(std::min(unsigned(gy), ny - 2));
+    const unsigned k(std::min(unsigned(gz), nz - 2));
+    const fcl::FCL_REAL s(gx - i);
+    const fcl::FCL_REAL t(gy - j);
+    const fcl::FCL_REAL u(gz - k);
+    const std::size_t slice(std::size_t(nx) * ny);
+    const float* c00(pDistances + std::size_t(k) * slice + std::size_t(j) * nx + i);
+    const float* c10(c00 + nx);
+    const float* c01(c00 + slice);
+    const float* c11(c01 + nx);
+
+    /* corners dxyz: d000 = c00[0], d100 = c00[1], d010 = c10[0], d001 = c01[0], ... */
+    const fcl::FCL_REAL e00(c00[0] + (c00[1] - c00[0]) * s);
+    const fcl::FCL_REAL e10(c10[0] + (c10[1] - c10[0]) * s);
+    const fcl::FCL_REAL e01(c01[0] + (c01[1] - c01[0]) * s);
+    const fcl::FCL_REAL e11(c11[0] + (c11[1] - c11[0]) * s);
+    const fcl::FCL_REAL f0(e00 + (e10 - e00) * t);
+    const fcl::FCL_REAL f1(e01 + (e11 - e01) * t);
+    d = f0 + (f1 - f0) * u;
+    const fcl::FCL_REAL ddx(((c00[1] - c00[0]) * (1.0 - t) + (c10[1] - c10[0]) * t) * (1.0 - u)
+        + ((c01[1] - c01[0]) * (1.0 - t) + (c11[1] - c11[0]) * t) * u);
+    const fcl::FCL_REAL ddy((e10 - e00) * (1.0 - u) + (e11 - e01) * u);
+    const fcl::FCL_REAL ddz(f1 - f0);
+    gradient.setValue(ddx / h, ddy / h, ddz / h);
+    return true;
+}
+
+} // FCL
@@ -0,0 +1,47 @@
+#ifndef SDF_H
+#define SDF_H
+
+#include <string>
+#include <fcl/shape/geometric_shapes.h>
+
+namespace FCL
+{
+
+/*
+ * Signed distance field sampled on a regular voxel grid, in the local frame of
+ * the collision object; distances are negative inside the part.  The grid is
+ * read from a binary file that is memory-mapped, laid out in native byte order as
+ *
+ *     char     magic[4] = "SDFV"
+ *     uint32   nx, ny, nz
+ *     float64  x0, y0, z0, h, (reserved, 0), (reserved, 0)
+ *     float32  d[nz][ny][nx]      distance at (x0 + i h, y0 + j h, z0 + k h) at d[k][j][i]
+ *
+ * Lookup reads the eight corners of the voxel holding the point, so its cost
+ * does not depend on the complexity of the part.
+ */
+class DistanceField : public fcl::ShapeBase {
+private:
+    void* pMap;
+    std::size_t map_size;
+    const float* pDistances;
+    unsigned nx;
+    unsigned ny;
+    unsigned nz;
+    fcl::FCL_REAL x0;
+    fcl::FCL_REAL y0;
+    fcl::FCL_REAL z0;
+    fcl::FCL_REAL h;
+public:
+    DistanceField(const std::string& file_name);
+    ~DistanceField(void);
+    void computeLocalAABB(void);
+    fcl::NODE_TYPE getNodeType(void) const;
+    fcl::FCL_REAL GetCellSize(void) const;
+    /* interpolated distance and its (unnormalised) gradient at local p; false outside the grid */
+    bool Distance(const fcl::Vec3f& p, fcl::FCL_REAL& d, fcl::Vec3f& gradient) const;
+};
+
+} // FCL
+
+#endif
@@ -0,0 +1,378 @@
+#include "mbconfig.h"           /* This goes first in every *.c,*.cc file */
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#ifdef USE_MULTITHREAD
+#include <pthread.h>
+#endif
+
+#include "subdomains.h"
+
+namespace FCL
+{
+
+SubdomainCollisionManager::SubdomainCollisionManager(unsigned num_domains, unsigned num_threads)
+: num_threads(std::max(num_threads, 1u)),
+axis(0),
+boundaries(std::max(num_domains, 1u) - 1, 0.0),
+domains(std::max(num_domains, 1u))
+{
+    for (std::vector<Subdomain>::iterator it = domains.begin(); it != domains.end(); it++) {
+        it->pManager = new fcl::DynamicAABBTreeCollisionManager();
+    }
+}
+
+SubdomainCollisionManager::~SubdomainCollisionManager(void)
+{
+    for (std::vector<Subdomain>::iterator it = domains.begin(); it != domains.end(); it++) {
+        delete it->pManager;
+    }
+}
+
+unsigned
+SubdomainCollisionManager::GetNumDomains(void) const
+{
+    return domains.size();
+}
+
+unsigned
+SubdomainCollisionManager::Domain(fcl::FCL_REAL x) const
+{
+    return std::upper_bound(boundaries.begin(), boundaries.end(), x) - boundaries.begin();
+}
+
+unsigned
+SubdomainCollisionManager::Domain(const fcl::CollisionObject* o1, const fcl::CollisionObject* o2) const
+{
+    return Domain(std::max(o1->getAABB().min_[axis], o2->getAABB().min_[axis]));
+}
+
+int
+SubdomainCollisionManager::GetAxis(void) const
+{
+    return axis;
+}
+
+const std::vector<fcl::FCL_REAL>&
+SubdomainCollisionManager::GetBoundaries(void) const
+{
+    return boundaries;
+}
+
+void
+SubdomainCollisionManager::SetPartition(int axis, const fcl::FCL_REAL* boundaries)
+{
+    this->axis = axis;
+    std::copy(boundaries, boundaries + this->boundaries.size(), this->boundaries.begin());
+}
+
+void
+SubdomainCollisionManager::Partition(void)
+{
+    /* unbounded objects such as planes do not move the boundaries */
+    std::vector<fcl::Vec3f> centers;
+    centers.reserve(objects.size());
+    for (std::vector<fcl::CollisionObject*>::const_iterator it = objects.begin(); it != objects.end(); it++) {
+        const fcl::Vec3f c((*it)->getAABB().center());
+        if (std::abs(c[0]) < std::numeric_limits<fcl::FCL_REAL>::max()
+            && std::abs(c[1]) < std::numeric_limits<fcl::FCL_REAL>::max()
+            && std::abs(c[2]) < std::numeric_limits<fcl::FCL_REAL>::max()) {
+            centers.push_back(c);
+        }
+    }
+    if (centers.empty()) {
+        std::fill(boundaries.begin(), boundaries.end(), 0.0);
+        return;
+    }
+    fcl::Vec3f cmin(centers[0]);
+    fcl::Vec3f cmax(centers[0]);
+    for (std::vector<fcl::Vec3f>::const_iterator it = centers.begin(); it != centers.end(); it++) {
+        cmin = fcl::min(cmin, *it);
+        cmax = fcl::max(cmax, *it);
+    }
+    const fcl::Vec3f extent(cmax - cmin);
+    axis = 0;
+    if (extent[1] > extent[axis]) {
+        axis = 1;
+    }
+    if (extent[2] > extent[axis]) {
+        axis = 2;
+    }
+    std::vector<fcl::FCL_REAL> x(centers.size());
+    for (std::size_t i = 0; i < centers.size(); i++) {
+        x[i] = centers[i][axis];
+    }
+    std::sort(x.begin(), x.end());
+    for (std::size_t k = 0; k < boundaries.size(); k++) {
+        boundaries[k] = x[((k + 1) * x.size()) / domains.size()];
+    }
+}
+
+void
+SubdomainCollisionManager::Assign(void)
+{
+    std::vector<std::vector<fcl::CollisionObject*> > new_members(domains.size());
+    for (std::vector<fcl::CollisionObject*>::const_iterator it = objects.begin(); it != objects.end(); it++) {
+        const fcl::AABB& aabb((*it)->getAABB());
+        const unsigned hi(Domain(aabb.max_[axis]));
+        for (unsigned d = Domain(aabb.min_[axis]); d <= hi; d++) {
+            new_members[d].push_back(*it);
+        }
+    }
+    for (unsigned d = 0; d < domains.size(); d++) {
+        SetMembers(d, new_members[d]);
+    }
+}
+
+void
+SubdomainCollisionManager::SetMembers(unsigned d, std::vector<fcl::CollisionObject*>& new_members)
+{
+    Subdomain& domain(domains[d]);
+    if (new_members == domain.members) {
+        domain.pManager->update();
+    } else {
+        /* objects crossed a boundary, rebuild the tree of this subdomain only */
+        domain.members.swap(new_members);
+        domain.pManager->clear();
+        domain.pManager->registerObjects(domain.members);
+        domain.pManager->setup();
+    }
+}
+
+bool
+SubdomainCollisionManager::CollisionFunction(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* cdata)
+{
+    CallbackData* pData(static_cast<CallbackData*>(cdata));
+    if (pData->pManager->Domain(o1, o2) == pData->domain) {
+        pData->pPairs->push_back(std::make_pair(o1, o2));
+    }
+    return false;
+}
+
+void
+SubdomainCollisionManager::Collide(unsigned first, unsigned stride) const
+{
+    for (unsigned d = first; d < domains.size(); d += stride) {
+        CallbackData data;
+        data.pManager = this;
+        data.domain = d;
+        data.pPairs = &domains[d].pairs;
+        domains[d].pairs.clear();
+        domains[d].pManager->collide(&data, CollisionFunction);
+    }
+}
+
+void*
+SubdomainCollisionManager::CollideThread(void* arg)
+{
+    ThreadData* pData(static_cast<ThreadData*>(arg));
+    pData->pManager->Collide(pData->first, pData->stride);
+    return NULL;
+}
+
+void
+SubdomainCollisionManager::registerObject(fcl::CollisionObject* obj)
+{
+    objects.push_back(obj);
+}
+
+void
+SubdomainCollisionManager::unregisterObject(fcl::CollisionObject* obj)
+{
+    objects.erase(std::remove(objects.begin(), objects.end(), obj), objects.end());
+}
+
+void
+SubdomainCollisionManager::setup(void)
+{
+    Partition();
+    Assign();
+}
+
+void
+SubdomainCollisionManager::Repartition(void)
+{
+    /* repartition only when the owners drift far from balance */
+    std::vector<std::size_t> owned(domains.size(), 0);
+    for (std::vector<fcl::CollisionObject*>::const_iterator it = objects.begin(); it != objects.end(); it++) {
+        owned[Domain((*it)->getAABB().center()[axis])]++;
+    }
+    if (*std::max_element(owned.begin(), owned.end()) > 2 * objects.size() / domains.size() + 1) {
+        Partition();
+    }
+}
+
+void
+SubdomainCollisionManager::update(void)
+{
+    Repartition();
+    Assign();
+}
+
+void
+SubdomainCollisionManager::update(fcl::CollisionObject* updated_obj)
+{
+    update();
+}
+
+void
+SubdomainCollisionManager::update(const std::vector<fcl::CollisionObject*>& updated_objs)
+{
+    /* membership depends on every object, no cheaper partial update */
+    update();
+}
+
+void
+SubdomainCollisionManager::clear(void)
+{
+    objects.clear();
+    for (std::vector<Subdomain>::iterator it = domains.begin(); it != domains.end(); it++) {
+        it->pManager->clear();
+        it->members.clear();
+        it->pairs.clear();
+    }
+}
+
+void
+SubdomainCollisionManager::getObjects(std::vector<fcl::CollisionObject*>& objs) const
+{
+    objs = objects;
+}
+
+void
+SubdomainCollisionManager::collide(fcl::CollisionObject* obj, void* cdata, fcl::CollisionCallBack callback) const
+{
+    for (std::vector<fcl::CollisionObject*>::const_iterator it = objects.begin(); it != objects.end(); it++) {
+        if (*it != obj && obj->getAABB().overlap((*it)->getAABB())) {
+            if (callback(obj, *it, cdata)) {
+                return;
+            }
+        }
+    }
+}
+
+void
+SubdomainCollisionManager::distance(fcl::CollisionObject* obj, void* cdata, fcl::DistanceCallBack callback) const
+{
+    fcl::FCL_REAL min_dist(std::numeric_limits<fcl::FCL_REAL>::max());
+    for (std::vector<fcl::CollisionObject*>::const_iterator it = objects.begin(); it != objects.end(); it++) {
+        if (*it != obj && callback(obj, *it, cdata, min_dist)) {
+            return;
+        }
+    }
+}
+
+void
+SubdomainCollisionManager::collide(void* cdata, fcl::CollisionCallBack callback) const
+{
+    const unsigned num_workers(std::min(num_threads, unsigned(domains.size())));
+#ifdef USE_MULTITHREAD
+    if (num_workers > 1) {
+        std::vector<pthread_t> threads(num_workers);
+        std::vector<ThreadData> data(num_workers);
+        for (unsigned t = 0; t < num_workers; t++) {
+            data[t].pManager = this;
+            data[t].first = t;
+            data[t].stride = num_workers;
+        }
+        for (unsigned t = 1; t < num_workers; t++) {
+            if (pthread_create(&threads[t], NULL, CollideThread, &data[t]) != 0) {
+                /* could not spawn, do these subdomains here */
+                CollideThread(&data[t]);
+                threads[t] = pthread_self();
+            }
+        }
+        CollideThread(&data[0]);
+        for (unsigned t = 1; t < num_workers; t++) {
+            if (!pthread_equal(threads[t], pthread_self())) {
+                pthread_join(threads[t], NULL);
+            }
+        }
+    } else
+#endif
+    {
+        Collide(0, 1);
+    }
+    for (std::vector<Subdomain>::const_iterator d = domains.begin(); d != domains.end(); d++) {
+        for (Pairs::const_iterator it = d->pairs.begin(); it != d->pairs.end(); it++) {
+            if (callback(it->first, it->second, cdata)) {
+                return;
+            }
+        }
+    }
+}
+
+void
+SubdomainCollisionManager::CollideDomain(unsigned d, void* cdata, fcl::CollisionCallBack callback)
+{
+    std::vector<fcl::CollisionObject*> new_members;
+    for (std::vector<fcl::CollisionObject*>::const_iterator it = objects.begin(); it != objects.end(); it++) {
+        const fcl::AABB& aabb((*it)->getAABB());
+        if (Domain(aabb.min_[axis]) <= d && d <= Domain(aabb.max_[axis])) {
+            new_members.push_back(*it);
+        }
+    }
+    SetMembers(d, new_members);
+    Collide(d, domains.size());
+    for (Pairs::const_iterator it = domains[d].pairs.begin(); it != domains[d].pairs.end(); it++) {
+        if (callback(it->first, it->second, cdata)) {
+            return;
+        }
+    }
+}
+
+void
+SubdomainCollisionManager::distance(void* cdata, fcl::DistanceCallBack callback) const
+{
+    fcl::FCL_REAL min_dist(std::numeric_limits<fcl::FCL_REAL>::max());
+    for (std::size_t a = 0; a < objects.size(); a++) {
+        for (std::size_t b = a + 1; b < objects.size(); b++) {
+            if (callback(objects[a], objects[b], cdata, min_dist)) {
+                return;
+            }
+        }
+    }
+}
+
+void
+SubdomainCollisionManager::collide(fcl::BroadPhaseCollisionManager* other_manager, void* cdata, fcl::CollisionCallBack callback) const
+{
+    if (other_manager == this) {
+        collide(cdata, callback);
+        return;
+    }
+    std::vector<fcl::CollisionObject*> objs;
+    other_manager->getObjects(objs);
+    for (std::vector<fcl::CollisionObject*>::const_iterator it = objs.begin(); it != objs.end(); it++) {
+        collide(*it, cdata, callback);
+    }
+}
+
+void
+SubdomainCollisionManager::distance(fcl::BroadPhaseCollisionManager* other_manager, void* cdata, fcl::DistanceCallBack callback) const
+{
+    if (other_manager == this) {
+        distance(cdata, callback);
+        return;
+    }
+    std::vector<fcl::CollisionObject*> objs;
+    other_manager->getObjects(objs);
+    for (std::vector<fcl::CollisionObject*>::const_iterator it = objs.begin(); it != objs.end(); it++) {
+        distance(*it, cdata, callback);
+    }
+}
+
+bool
+SubdomainCollisionManager::empty(void) const
+{
+    return objects.empty();
+}
+
+size_t
+SubdomainCollisionManager::size(void) const
+{
+    return objects.size();
+}
+
+} // FCL
@@ -0,0 +1,89 @@
+#ifndef SUBDOMAINS_H
+#define SUBDOMAINS_H
+
+#include <vector>
+#include <fcl/broadphase/broadphase.h>
+
+namespace FCL
+{
+
+/*
+ * Spatial domain decomposition of the broadphase.
+ *
+ * Space is cut into slabs along the axis where object centers spread the most,
+ * with boundaries at quantiles of the centers so that each subdomain holds about
+ * the same number of objects.  Each subdomain has its own dynamic AABB tree with
+ * every object whose AABB reaches into the slab, so objects crossing a boundary
+ * appear as ghosts in the neighbors.  A pair belongs to the subdomain holding
+ * the lower bound of the overlap of the two AABBs along the axis, which both
+ * objects reach, so each pair is found once.  Subdomains are searched on worker
+ * threads and their pairs handed to the callback serially in subdomain order.
+ * Worker processes instead search their own subdomains on their copy of the
+ * manager, with the cuts the solver made and handed to them.
+ */
+class SubdomainCollisionManager : public fcl::BroadPhaseCollisionManager {
+private:
+    typedef std::vector<std::pair<fcl::CollisionObject*, fcl::CollisionObject*> > Pairs;
+    struct Subdomain {
+        fcl::BroadPhaseCollisionManager* pManager;
+        std::vector<fcl::CollisionObject*> members;
+        Pairs pairs;
+    };
+    struct ThreadData {
+        const SubdomainCollisionManager* pManager;
+        unsigned first;
+        unsigned stride;
+    };
+    struct CallbackData {
+        const SubdomainCollisionManager* pManager;
+        unsigned domain;
+        Pairs* pPairs;
+    };
+    std::vector<fcl::CollisionObject*> objects;
+    unsigned num_threads;
+    int axis;
+    std::vector<fcl::FCL_REAL> boundaries;
+    mutable std::vector<Subdomain> domains;
+    void Partition(void);
+    void Assign(void);
+    void SetMembers(unsigned d, std::vector<fcl::CollisionObject*>& new_members);
+    void Collide(unsigned first, unsigned stride) const;
+    static void* CollideThread(void* arg);
+    static bool CollisionFunction(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* cdata);
+public:
+    SubdomainCollisionManager(unsigned num_domains, unsigned num_threads = 1);
+    ~SubdomainCollisionManager(void);
+    unsigned GetNumDomains(void) const;
+    /* subdomain of a point along the split axis */
+    unsigned Domain(fcl::FCL_REAL x) const;
+    /* subdomain that owns the pair of overlapping objects */
+    unsigned Domain(const fcl::CollisionObject* o1, const fcl::CollisionObject* o2) const;
+    /* cuts the slabs again if their owners drifted far from balance */
+    void Repartition(void);
+    int GetAxis(void) const;
+    const std::vector<fcl::FCL_REAL>& GetBoundaries(void) const;
+    /* takes the cuts of another manager over the same objects, GetNumDomains() - 1 boundaries */
+    void SetPartition(int axis, const fcl::FCL_REAL* boundaries);
+    /* refits or rebuilds subdomain d alone, and hands its pairs to the callback */
+    void CollideDomain(unsigned d, void* cdata, fcl::CollisionCallBack callback);
+    void registerObject(fcl::CollisionObject* obj);
+    void unregisterObject(fcl::CollisionObject* obj);
+    void setup(void);
+    void update(void);
+    void update(fcl::CollisionObject* updated_obj);
+    void update(const std::vector<fcl::CollisionObject*>& updated_objs);
+    void clear(void);
+    void getObjects(std::vector<fcl::CollisionObject*>& objs) const;
+    void collide(fcl::CollisionObject* obj, void* cdata, fcl::CollisionCallBack callback) const;
+    void distance(fcl::CollisionObject* obj, void* cdata, fcl::DistanceCallBack callback) const;
+    void collide(void* cdata, fcl::CollisionCallBack callback) const;
+    void distance(void* cdata, fcl::DistanceCallBack callback) const;
+    void collide(fcl::BroadPhaseCollisionManager* other_manager, void* cdata, fcl::CollisionCallBack callback) const;
+    void distance(fcl::BroadPhaseCollisionManager* other_manager, void* cdata, fcl::DistanceCallBack callback) const;
+    bool empty(void) const;
+    size_t size(void) const;
+};
+
+} // FCL
+
+#endif
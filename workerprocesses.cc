@@ -0,0 +1,174 @@
+#include "mbconfig.h"           /* This goes first in every *.c,*.cc file */
+
+#include <cerrno>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "workerprocesses.h"
+
+/* areas start on cache lines, so that workers do not write into each other's lines */
+static std::size_t
+RoundUp(std::size_t size)
+{
+    return (size + 63) & ~std::size_t(63);
+}
+
+WorkerProcesses::WorkerProcesses(unsigned num_workers, std::size_t common_size, std::size_t worker_size,
+    WorkFunc work, void* arg)
+: common_size(RoundUp(common_size)),
+worker_size(RoundUp(worker_size)),
+pMap(MAP_FAILED),
+map_size(this->common_size + num_workers * this->worker_size)
+{
+    if (num_workers == 0) {
+        throw std::runtime_error("worker processes need at least one worker");
+    }
+    pMap = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (pMap == MAP_FAILED) {
+        throw std::runtime_error("unable to map the memory shared with the worker processes");
+    }
+    /* all the socket pairs exist before the first fork, so that each worker can close the others' */
+    std::vector<int> child_sockets;
+    for (unsigned w = 0; w < num_workers; w++) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+            for (unsigned i = 0; i < w; i++) {
+                close(sockets[i]);
+                close(child_sockets[i]);
+            }
+            munmap(pMap, map_size);
+            throw std::runtime_error("unable to create the sockets of the worker processes");
+        }
+        sockets.push_back(sv[0]);
+        child_sockets.push_back(sv[1]);
+    }
+    for (unsigned w = 0; w < num_workers; w++) {
+        const pid_t pid(fork());
+        if (pid == 0) {
+            for (unsigned i = 0; i < num_workers; i++) {
+                close(sockets[i]);
+                if (i != w) {
+                    close(child_sockets[i]);
+                }
+            }
+            Serve(child_sockets[w], w, work, arg);
+        }
+        if (pid == -1) {
+            for (unsigned i = w; i < num_workers; i++) {
+                close(sockets[i]);
+                close(child_sockets[i]);
+            }
+            sockets.resize(w);
+            for (unsigned i = 0; i < w; i++) {
+                close(child_sockets[i]);
+            }
+            Stop();
+            throw std::runtime_error("unable to fork the worker processes");
+        }
+        pids.push_back(pid);
+    }
+    for (unsigned w = 0; w < num_workers; w++) {
+        close(child_sockets[w]);
+    }
+}
+
+WorkerProcesses::~WorkerProcesses(void)
+{
+    Stop();
+}
+
+void
+WorkerProcesses::Stop(void)
+{
+    /* a worker leaves on the quit byte, or when its socket closes */
+    for (std::size_t w = 0; w < sockets.size(); w++) {
+        const char c('q');
+        send(sockets[w], &c, 1, MSG_NOSIGNAL);
+        close(sockets[w]);
+    }
+    for (std::size_t w = 0; w < pids.size(); w++) {
+        pid_t pid;
+        do {
+            pid = waitpid(pids[w], NULL, 0);
+        } while (pid == -1 && errno == EINTR);
+    }
+    sockets.clear();
+    pids.clear();
+    if (pMap != MAP_FAILED) {
+        munmap(pMap, map_size);
+        pMap = MAP_FAILED;
+    }
+}
+
+void
+WorkerProcesses::Serve(int fd, unsigned worker, WorkFunc work, void* arg) const
+{
+    for (;;) {
+        char c;
+        const ssize_t n(recv(fd, &c, 1, 0));
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n != 1 || c != 'r') {
+            _exit(0);
+        }
+        try {
+            work(worker, arg, pMap, pGetWorker(worker));
+            c = 'd';
+        } catch (...) {
+            c = 'e';
+        }
+        if (send(fd, &c, 1, MSG_NOSIGNAL) != 1 || c == 'e') {
+            _exit(1);
+        }
+    }
+}
+
+unsigned
+WorkerProcesses::GetNumWorkers(void) const
+{
+    return pids.size();
+}
+
+void*
+WorkerProcesses::pGetCommon(void) const
+{
+    return pMap;
+}
+
+void*
+WorkerProcesses::pGetWorker(unsigned worker) const
+{
+    return static_cast<char*>(pMap) + common_size + worker * worker_size;
+}
+
+void
+WorkerProcesses::Run(void)
+{
+    /* the socket round trip orders the accesses to the shared areas on both sides */
+    for (std::size_t w = 0; w < sockets.size(); w++) {
+        const char c('r');
+        if (send(sockets[w], &c, 1, MSG_NOSIGNAL) != 1) {
+            std::ostringstream os;
+            os << "worker process " << w << " (pid " << pids[w] << ") is gone";
+            throw std::runtime_error(os.str());
+        }
+    }
+    for (std::size_t w = 0; w < sockets.size(); w++) {
+        char c(0);
+        ssize_t n;
+        do {
+            n = recv(sockets[w], &c, 1, 0);
+        } while (n == -1 && errno == EINTR);
+        if (n != 1 || c != 'd') {
+            std::ostringstream os;
+            os << "worker process " << w << " (pid " << pids[w] << ") "
+                << (n == 1 ? "failed" : "exited");
+            throw std::runtime_error(os.str());
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef WORKERPROCESSES_H
+#define WORKERPROCESSES_H
+
+#include <vector>
+#include <sys/types.h>
+
+/*
+ * Local worker processes forked from the solver, cooperating with it through
+ * one anonymous shared mapping: a common area the solver fills before each
+ * round, and one area per worker that the worker fills with its results.
+ * Each worker is started and answers through its own socket pair; a worker
+ * that dies closes its end, which Run() reports instead of waiting forever.
+ *
+ * A worker runs work on the memory image the solver had when it was forked,
+ * at the same addresses, and leaves through _exit() so that it never flushes
+ * or closes anything of the solver.  Anything that changes in the solver after
+ * the fork, this object included, reaches the workers only through the common
+ * area.
+ */
+class WorkerProcesses {
+public:
+    /* common is the area the solver filled, results the area of this worker */
+    typedef void (*WorkFunc)(unsigned worker, void* arg, const void* common, void* results);
+private:
+    std::size_t common_size;
+    std::size_t worker_size;
+    void* pMap;
+    std::size_t map_size;
+    std::vector<pid_t> pids;
+    std::vector<int> sockets;
+    void Serve(int fd, unsigned worker, WorkFunc work, void* arg) const;
+    void Stop(void);
+public:
+    /* forks num_workers workers, each running work once per round */
+    WorkerProcesses(unsigned num_workers, std::size_t common_size, std::size_t worker_size,
+        WorkFunc work, void* arg);
+    ~WorkerProcesses(void);
+    unsigned GetNumWorkers(void) const;
+    void* pGetCommon(void) const;
+    void* pGetWorker(unsigned worker) const;
+    /* starts a round on every worker and waits until all of them are done */
+    void Run(void);
+};
+
+#endif